@@ -0,0 +1,194 @@
+#ifndef YACIS_ANALYSIS_ARENA_HPP_
+#define YACIS_ANALYSIS_ARENA_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/profile.hpp"
+#include "yacis/analysis/stats.hpp"
+
+namespace yacis::analysis {
+
+/**
+ * @brief Bump allocator. Memory is only released in bulk by reset, blocks are
+ *        kept for reuse. Once capacity is used up, the arena reports full and
+ *        new objects should go to the global heap, so long-running evaluations
+ *        do not grow it without bound.
+ */
+class Arena {
+  public:
+    static constexpr size_t block_size = 64 * 1024;
+
+    const size_t capacity;
+
+    explicit Arena(size_t capacity = 16 * 1024 * 1024): capacity(capacity) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    [[nodiscard]] bool full() const noexcept {
+        return used >= capacity;
+    }
+
+    [[nodiscard]] size_t size() const noexcept {
+        return used;
+    }
+
+    [[nodiscard]] size_t count() const noexcept {
+        return num;
+    }
+
+    void* allocate(size_t size, size_t align) {
+        used += size;
+        ++num;
+        auto space = static_cast<size_t>(end - curr);
+        void* ptr = curr;
+        if (!curr || !std::align(align, size, ptr, space)) {
+            next_block(size + align);
+            ptr = curr;
+            space = static_cast<size_t>(end - curr);
+            std::align(align, size, ptr, space);
+        }
+        curr = static_cast<char*>(ptr) + size;
+        return ptr;
+    }
+
+    /**
+     * @brief Release all allocated memory. All objects in this arena should
+     *        have been destroyed.
+     */
+    void reset() noexcept {
+        used = 0;
+        num = 0;
+        block_index = 0;
+        curr = blocks.empty() ? nullptr : blocks[0].first.get();
+        end = blocks.empty() ? nullptr : curr + blocks[0].second;
+    }
+
+  private:
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks;
+    size_t block_index = 0;
+    size_t used = 0;
+    size_t num = 0;  // number of allocations
+    char* curr = nullptr;
+    char* end = nullptr;
+
+    void next_block(size_t min_size) {
+        if (curr) ++block_index;
+        while (block_index < blocks.size() &&
+               blocks[block_index].second < min_size)
+            ++block_index;
+        if (block_index == blocks.size()) {
+            auto size = std::max(block_size, min_size);
+            blocks.emplace_back(std::make_unique<char[]>(size), size);
+        }
+        curr = blocks[block_index].first.get();
+        end = curr + blocks[block_index].second;
+    }
+};
+
+/**
+ * @brief Arena used by runtime objects created in this thread. Null means the
+ *        global heap.
+ */
+inline thread_local Arena* curr_arena = nullptr;
+
+/**
+ * @brief Set curr_arena during the lifetime of this object. The arena is reset
+ *        on destruction, so objects allocated in scope must not escape. Its
+ *        bytes are refunded to curr_budget then.
+ */
+class ArenaScope {
+  public:
+    explicit ArenaScope(Arena* arena): arena(arena), prev(curr_arena) {
+        curr_arena = arena;
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    ~ArenaScope() {
+        curr_arena = prev;
+        if (!arena) return;
+        if (curr_budget) curr_budget->refund_bytes(arena->size());
+        if (curr_stats) curr_stats->released(arena->count(), arena->size());
+        arena->reset();
+    }
+
+  private:
+    Arena* arena;
+    Arena* prev;
+};
+
+template<typename T>
+class ArenaAllocator {
+  public:
+    using value_type = T;
+
+    Arena* arena;  // should be observer_ptr, null for the global heap
+
+    explicit ArenaAllocator(Arena* arena = nullptr) noexcept: arena(arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept:
+        arena(other.arena) {}
+
+    /**
+     * @brief Allocate n objects, charged to curr_budget if any until they are
+     *        deallocated, or until the arena is reset, and recorded by
+     *        curr_recorder and curr_stats if any.
+     */
+    T* allocate(size_t n) {
+        if (curr_budget) curr_budget->charge_bytes(n * sizeof(T));
+        if (curr_recorder) curr_recorder->allocated(n * sizeof(T));
+        if (curr_stats) curr_stats->allocated(n * sizeof(T));
+        if (arena)
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if (arena) return;
+        if (curr_budget) curr_budget->refund_bytes(n * sizeof(T));
+        if (curr_stats) curr_stats->released(1, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    friend bool operator==(const ArenaAllocator& lhs,
+                           const ArenaAllocator<U>& rhs) noexcept {
+        return lhs.arena == rhs.arena;
+    }
+
+    template<typename U>
+    friend bool operator!=(const ArenaAllocator& lhs,
+                           const ArenaAllocator<U>& rhs) noexcept {
+        return lhs.arena != rhs.arena;
+    }
+};
+
+/**
+ * @brief Return an allocator of curr_arena, or of the global heap if there is
+ *        no arena or it is full.
+ */
+template<typename T>
+ArenaAllocator<T> curr_allocator() noexcept {
+    return ArenaAllocator<T>(
+        curr_arena && !curr_arena->full() ? curr_arena : nullptr);
+}
+
+/**
+ * @brief Create a runtime object with curr_allocator.
+ */
+template<typename T, typename... Args>
+std::shared_ptr<T> make_obj(Args&&... args) {
+    return std::allocate_shared<T>(curr_allocator<T>(),
+                                   std::forward<Args>(args)...);
+}
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_ARENA_HPP_
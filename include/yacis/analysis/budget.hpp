@@ -0,0 +1,214 @@
+#ifndef YACIS_ANALYSIS_BUDGET_HPP_
+#define YACIS_ANALYSIS_BUDGET_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+namespace yacis::analysis {
+
+enum class LimitTag {
+    kSteps,     // more reduction steps than max_steps
+    kBytes,     // more live bytes of runtime objects than max_bytes
+    kDepth,     // evaluation nested deeper than max_depth
+    kCancelled  // cancel flag set by another thread
+};
+
+/**
+ * @brief Thrown by the runtime once a budget is exceeded, and turned into
+ *        LimitError at the statement being evaluated.
+ */
+struct LimitExceeded: std::exception {
+    LimitTag tag;
+
+    explicit LimitExceeded(LimitTag tag) noexcept: tag(tag) {}
+
+    [[nodiscard]] const char* what() const noexcept override {
+        return "Evaluation limit exceeded.";
+    }
+};
+
+/**
+ * @brief Limits of one evaluation, shared by all its threads. A limit of 0
+ *        means none.
+ *
+ *        Steps are counted per thread and charged in batches of interval, so
+ *        the shared counter and the cancel flag are only touched once in a
+ *        while. Depth is counted per thread, as each has a stack of its own.
+ *        Whatever the limits, nesting also stops short of the end of the
+ *        native stack, see DepthGuard.
+ */
+class Budget {
+  public:
+    static constexpr size_t check_interval = 1024;
+    // Native stack left for unwinding once nesting is stopped.
+    static constexpr size_t stack_reserve = 256u << 10u;
+    // Native stack assumed to be usable below the first budgeted frame of a
+    // thread, where its bounds are unknown.
+    static constexpr size_t fallback_stack_size = 512u << 10u;
+
+    const size_t max_steps;
+    const size_t max_bytes;
+    const size_t max_depth;
+    const std::atomic<bool>* cancel;  // should be observer_ptr
+    const size_t interval;  // steps charged at a time
+
+    Budget(size_t max_steps,
+           size_t max_bytes,
+           size_t max_depth,
+           const std::atomic<bool>* cancel) noexcept:
+        max_steps(max_steps),
+        max_bytes(max_bytes),
+        max_depth(max_depth),
+        cancel(cancel),
+        interval(max_steps ? std::min(max_steps, check_interval)
+                           : check_interval) {}
+
+    Budget(const Budget&) = delete;
+    Budget& operator=(const Budget&) = delete;
+
+    void charge_steps(size_t num) {
+        if (cancel && cancel->load(std::memory_order_relaxed))
+            throw LimitExceeded(LimitTag::kCancelled);
+        auto total = steps.fetch_add(num, std::memory_order_relaxed) + num;
+        if (max_steps && total > max_steps)
+            throw LimitExceeded(LimitTag::kSteps);
+    }
+
+    void charge_bytes(size_t num) {
+        auto total = bytes.fetch_add(num, std::memory_order_relaxed) + num;
+        if (max_bytes && total > max_bytes) {
+            bytes.fetch_sub(num, std::memory_order_relaxed);
+            throw LimitExceeded(LimitTag::kBytes);
+        }
+    }
+
+    void refund_bytes(size_t num) noexcept {
+        bytes.fetch_sub(num, std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<size_t> steps{0};
+    std::atomic<size_t> bytes{0};
+};
+
+/**
+ * @brief Budget charged by evaluation in this thread. Null means unlimited.
+ */
+inline thread_local Budget* curr_budget = nullptr;
+inline thread_local size_t budget_ticks = 0;  // steps not charged yet
+inline thread_local size_t budget_depth = 0;
+// Lowest address of the native stack evaluation in this thread may use, 0
+// until a budget is set in it.
+inline thread_local uintptr_t budget_stack_floor = 0;
+
+/**
+ * @brief Return the address of a local variable of the caller, standing for
+ *        the top of the native stack.
+ */
+inline uintptr_t stack_top() noexcept {
+    char probe = 0;
+    return reinterpret_cast<uintptr_t>(&probe);
+}
+
+/**
+ * @brief Return the lowest address of the native stack of this thread that
+ *        evaluation may use, Budget::stack_reserve above its end. The stack is
+ *        assumed to grow down.
+ */
+inline uintptr_t find_stack_floor() noexcept {
+#if defined(__linux__)
+    pthread_attr_t attr;
+    if (!pthread_getattr_np(pthread_self(), &attr)) {
+        void* addr = nullptr;
+        size_t size = 0;
+        auto found = !pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        if (found && size > 2 * Budget::stack_reserve)
+            return reinterpret_cast<uintptr_t>(addr) + Budget::stack_reserve;
+    }
+#endif
+    auto top = stack_top();
+    auto size = Budget::fallback_stack_size - Budget::stack_reserve;
+    return top > size ? top - size : 0;
+}
+
+/**
+ * @brief Set curr_budget during the lifetime of this object. Steps and depth
+ *        counted for another budget are put aside meanwhile.
+ */
+class BudgetScope {
+  public:
+    explicit BudgetScope(Budget* budget) noexcept:
+        budget(budget),
+        prev(curr_budget),
+        prev_ticks(budget_ticks),
+        prev_depth(budget_depth) {
+        if (budget != prev) budget_ticks = budget_depth = 0;
+        if (budget && !budget_stack_floor)
+            budget_stack_floor = find_stack_floor();
+        curr_budget = budget;
+    }
+
+    BudgetScope(const BudgetScope&) = delete;
+    BudgetScope& operator=(const BudgetScope&) = delete;
+
+    ~BudgetScope() {
+        curr_budget = prev;
+        if (budget == prev) return;
+        budget_ticks = prev_ticks;
+        budget_depth = prev_depth;
+    }
+
+  private:
+    Budget* budget;  // should be observer_ptr
+    Budget* prev;
+    size_t prev_ticks;
+    size_t prev_depth;
+};
+
+/**
+ * @brief Count a reduction step against budget, which must not be null.
+ */
+inline void tick_budget(Budget* budget) {
+    if (++budget_ticks < budget->interval) return;
+    budget_ticks = 0;
+    budget->charge_steps(budget->interval);
+}
+
+/**
+ * @brief Count a nested evaluation against budget during the lifetime of this
+ *        object. Nesting also stops once the native stack nearly runs out, so
+ *        that unbounded recursion under any budget ends in LimitExceeded
+ *        instead of a crash. Does nothing if budget is null.
+ */
+class DepthGuard {
+  public:
+    explicit DepthGuard(Budget* budget): budget(budget) {
+        if (!budget) return;
+        if ((budget->max_depth && budget_depth >= budget->max_depth) ||
+            stack_top() < budget_stack_floor)
+            throw LimitExceeded(LimitTag::kDepth);
+        ++budget_depth;
+    }
+
+    DepthGuard(const DepthGuard&) = delete;
+    DepthGuard& operator=(const DepthGuard&) = delete;
+
+    ~DepthGuard() {
+        if (budget) --budget_depth;
+    }
+
+  private:
+    Budget* budget;  // should be observer_ptr
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_BUDGET_HPP_
@@ -0,0 +1,260 @@
+#ifndef YACIS_ANALYSIS_BYTECODE_HPP_
+#define YACIS_ANALYSIS_BYTECODE_HPP_
+
+#include <any>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yacis/analysis/replace.hpp"
+#include "yacis/analysis/type.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+enum class OpCode : uint8_t {
+    kConst,       // push arg
+    kArg,         // push frame slot arg
+    kGlobal,      // push global variable arg
+    kClosure,     // push closure of chunk arg with its captures
+    kCall,        // apply arg values to the function below them
+    kTailCall,    // kCall in tail position, reuses current frame
+    kJump,        // jump to arg
+    kJumpIfNot,   // pop, jump to arg if zero
+    kReturn,      // return top of stack
+
+    // Primitive operations, operands are popped from stack
+    kNegate,
+    kAdd,
+    kSub,
+    kMul,
+    kDiv,
+    kMod,
+    kEq,
+    kNeq,
+    kLt,
+    kGt,
+    kLeq,
+    kGeq,
+    kAnd,
+    kOr,
+    kNot
+};
+
+struct Instr {
+    OpCode op;
+    int32_t arg;
+};
+
+struct Chunk {
+    size_t arg_num = 0;
+    std::vector<size_t> captures;  // slots of the frame creating the closure
+    std::vector<Instr> code;
+
+    /**
+     * @brief Append an instruction and return its position.
+     */
+    size_t emit(OpCode op, int32_t arg = 0) {
+        code.push_back({op, arg});
+        return code.size() - 1;
+    }
+};
+
+/**
+ * @brief A top-level statement to be executed in source order. A global entry
+ *        stores the result of its chunk into global variables while an output
+ *        entry appends the result to output.
+ */
+struct Entry {
+    bool is_output;
+    size_t chunk;
+    Type type;
+    ast::BaseNode::iterator_t pos;  // of the statement, for errors
+    std::string name;  // of the global variable defined, empty if output
+};
+
+struct Program {
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    std::vector<Entry> entries;
+    size_t builtin_num = 0;
+};
+
+namespace internal {
+
+/**
+ * @brief Return the opcode of builtin op.
+ */
+inline OpCode builtin_opcode(BuiltinOp op) {
+    switch (op) {
+    case BuiltinOp::kNegate:
+        return OpCode::kNegate;
+    case BuiltinOp::kAdd:
+        return OpCode::kAdd;
+    case BuiltinOp::kSub:
+        return OpCode::kSub;
+    case BuiltinOp::kMul:
+        return OpCode::kMul;
+    case BuiltinOp::kDiv:
+        return OpCode::kDiv;
+    case BuiltinOp::kMod:
+        return OpCode::kMod;
+    case BuiltinOp::kEq:
+        return OpCode::kEq;
+    case BuiltinOp::kNeq:
+        return OpCode::kNeq;
+    case BuiltinOp::kLt:
+        return OpCode::kLt;
+    case BuiltinOp::kGt:
+        return OpCode::kGt;
+    case BuiltinOp::kLeq:
+        return OpCode::kLeq;
+    case BuiltinOp::kGeq:
+        return OpCode::kGeq;
+    case BuiltinOp::kAnd:
+        return OpCode::kAnd;
+    case BuiltinOp::kOr:
+        return OpCode::kOr;
+    case BuiltinOp::kNot:
+        return OpCode::kNot;
+    }
+    return OpCode::kNot;
+}
+
+class BytecodeVisitor: public ast::BaseVisitor {
+  public:
+    Program program;
+    Chunk* curr = nullptr;  // should be observer_ptr
+    bool is_tail = false;
+
+    BytecodeVisitor() {
+        // Builtin i is chunk i. Operands are pushed in application order.
+        for (auto&& builtin : builtins) {
+            auto& chunk = new_chunk(builtin.arg_num);
+            for (size_t i = 0; i < builtin.arg_num; ++i)
+                chunk.emit(OpCode::kArg, i);
+            chunk.emit(builtin_opcode(builtin.op));
+            chunk.emit(OpCode::kReturn);
+        }
+        program.builtin_num = builtins.size();
+    }
+
+    Chunk& new_chunk(size_t arg_num) {
+        program.chunks.push_back(std::make_unique<Chunk>());
+        program.chunks.back()->arg_num = arg_num;
+        return *program.chunks.back();
+    }
+
+    void call(std::unique_ptr<ast::BaseNode>& p, bool tail = false) {
+        auto temp = is_tail;
+        is_tail = tail;
+        p->accept(this);
+        is_tail = temp;
+    }
+
+    /**
+     * @brief Compile an expression into a new chunk and return its index.
+     */
+    size_t compile_chunk(std::unique_ptr<ast::BaseNode>& p, size_t arg_num) {
+        auto temp = curr;
+        curr = &new_chunk(arg_num);
+        auto index = program.chunks.size() - 1;
+        call(p, true);
+        curr->emit(OpCode::kReturn);
+        curr = temp;
+        return index;
+    }
+
+    std::any visit(ast::BaseNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::ValNode& n) override {
+        curr->emit(OpCode::kConst, n.value);
+        return std::any();
+    }
+
+    std::any visit(ast::ArgNode& n) override {
+        curr->emit(OpCode::kArg, n.index);
+        return std::any();
+    }
+
+    std::any visit(ast::GlobalNode& n) override {
+        curr->emit(OpCode::kGlobal, n.index);
+        return std::any();
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        auto& head = n.children[0];
+        auto arg_num = n.children.size() - 1;
+        if (head->tag == ast::NodeTag::kGlobal) {
+            auto index = ast::as<ast::GlobalNode>(head).index;
+            if (const auto* builtin = saturated_builtin(index, arg_num)) {
+                for (size_t i = 1; i < n.children.size(); ++i)
+                    call(n.children[i]);
+                curr->emit(builtin_opcode(builtin->op));
+                return std::any();
+            }
+        }
+        for (auto&& i : n.children) call(i);
+        curr->emit(is_tail ? OpCode::kTailCall : OpCode::kCall, arg_num);
+        return std::any();
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        call(n.children[0]);
+        auto if_jump = curr->emit(OpCode::kJumpIfNot);
+        call(n.children[1], is_tail);
+        auto then_jump = curr->emit(OpCode::kJump);
+        curr->code[if_jump].arg = curr->code.size();
+        call(n.children[2], is_tail);
+        curr->code[then_jump].arg = curr->code.size();
+        return std::any();
+    }
+
+    std::any visit(ast::LambdaExprNode& n) override {
+        auto index = compile_chunk(n.children.back(), n.children.size() - 1);
+        program.chunks[index]->captures = n.info.captures;
+        curr->emit(OpCode::kClosure, index);
+        return std::any();
+    }
+
+    std::any visit(ast::ValueAssignNode& n) override {
+        program.entries.push_back(
+            {false,
+             compile_chunk(n.children[1], 0),
+             Type(),
+             n.m_begin,
+             ast::as<ast::VarNameNode>(n.children[0]).info.name});
+        return std::any();
+    }
+
+    std::any visit(ast::OutputNode& n) override {
+        program.entries.push_back(
+            {true,
+             compile_chunk(n.children[0], 0),
+             n.info.type,
+             n.m_begin,
+             {}});
+        return std::any();
+    }
+};
+
+/**
+ * @brief Compile replaced ast into bytecode.
+ * @param root Root node of AST.
+ */
+inline Program compile_bytecode(std::unique_ptr<ast::BaseNode>& root) {
+    BytecodeVisitor visitor;
+    visitor.call(root);
+    return std::move(visitor.program);
+}
+
+}  // namespace internal
+
+using internal::compile_bytecode;
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_BYTECODE_HPP_
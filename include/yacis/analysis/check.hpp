@@ -207,6 +207,7 @@ class CheckVisitor: public ast::BaseVisitor {
         } else {
             (*type_table)[name] = type;
         }
+        n.info.type = type;
         return std::any();
     }
 
@@ -0,0 +1,150 @@
+#ifndef YACIS_ANALYSIS_DEPEND_HPP_
+#define YACIS_ANALYSIS_DEPEND_HPP_
+
+#include <any>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "yacis/analysis/replace.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+/**
+ * @brief Top-level statement, either a definition or an output, with the user
+ *        global variables it refers to, which are all defined before it.
+ *
+ *        Only direct references are listed. Once the statements defining them
+ *        have been evaluated, so have the ones they refer to in turn, which is
+ *        all that calling a function defined by them may need.
+ */
+struct Dependency {
+    bool is_output;
+    size_t index;              // global index defined, or index in output
+    std::vector<size_t> uses;  // ascending global indices, itself excluded
+};
+
+namespace internal {
+
+class DependVisitor: public ast::BaseVisitor {
+  public:
+    std::vector<Dependency> graph;
+    std::set<size_t> uses;
+    size_t global_count = init_global_table.size();
+    size_t output_count = 0;
+
+    void call(std::unique_ptr<ast::BaseNode>& p) {
+        p->accept(this);
+    }
+
+    std::any visit(ast::BaseNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::GlobalNode& n) override {
+        if (n.index >= init_global_table.size()) uses.insert(n.index);
+        return std::any();
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::LambdaExprNode& n) override {
+        call(n.children.back());
+        return std::any();
+    }
+
+    std::any visit(ast::ValueAssignNode& n) override {
+        auto index = global_count++;
+        call(n.children[1]);
+        uses.erase(index);
+        graph.push_back({false, index, {uses.begin(), uses.end()}});
+        uses.clear();
+        return std::any();
+    }
+
+    std::any visit(ast::OutputNode& n) override {
+        call(n.children[0]);
+        graph.push_back({true, output_count++, {uses.begin(), uses.end()}});
+        uses.clear();
+        return std::any();
+    }
+};
+
+/**
+ * @brief Build the dependency graph of top-level statements.
+ * @param root Root node of replaced AST.
+ * @return Statements in source order.
+ */
+inline std::vector<Dependency> depend(std::unique_ptr<ast::BaseNode>& root) {
+    DependVisitor visitor;
+    visitor.call(root);
+    return std::move(visitor.graph);
+}
+
+/**
+ * @brief Set global indices of GlobalNode in n by table, which maps old user
+ *        global indices to new ones.
+ */
+inline void renumber_globals(ast::BaseNode& n,
+                             const std::vector<size_t>& table) {
+    if (n.tag == ast::NodeTag::kGlobal) {
+        auto& index = static_cast<ast::GlobalNode&>(n).index;
+        if (index >= init_global_table.size())
+            index = table[index - init_global_table.size()];
+        return;
+    }
+    for (auto&& i : n.children) renumber_globals(*i, table);
+}
+
+/**
+ * @brief Remove definitions of global variables no output depends on, even
+ *        indirectly, and renumber the others.
+ * @param root Root node of replaced AST.
+ * @return Number of definitions removed.
+ */
+inline size_t eliminate_dead(std::unique_ptr<ast::BaseNode>& root) {
+    auto graph = depend(root);
+    auto builtin_num = init_global_table.size();
+    std::vector<bool> is_live;
+    for (auto&& i : graph)
+        if (!i.is_output) is_live.push_back(false);
+
+    // Statements only use globals defined before them.
+    for (auto it = graph.rbegin(); it != graph.rend(); ++it) {
+        if (!it->is_output && !is_live[it->index - builtin_num]) continue;
+        for (auto i : it->uses) is_live[i - builtin_num] = true;
+    }
+
+    std::vector<size_t> table;
+    size_t global_count = builtin_num;
+    for (auto i : is_live) table.push_back(i ? global_count++ : 0);
+    if (global_count - builtin_num == is_live.size()) return 0;
+
+    ast::BaseNode::children_t children;
+    size_t index = 0;
+    for (auto&& i : root->children)
+        if (i->tag != ast::NodeTag::kValueAssign || is_live[index++])
+            children.push_back(std::move(i));
+    root->children = std::move(children);
+    renumber_globals(*root, table);
+    return is_live.size() - (global_count - builtin_num);
+}
+
+}  // namespace internal
+
+using internal::depend;
+using internal::eliminate_dead;
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_DEPEND_HPP_
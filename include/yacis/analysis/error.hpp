@@ -7,6 +7,7 @@
 #include <string>
 
 #include "tao/pegtl.hpp"
+#include "yacis/analysis/budget.hpp"
 
 namespace yacis::analysis {
 
@@ -53,6 +54,32 @@ class ParseError: public CompileError {
                      "ParseError: " + error_message) {}
 };
 
+/**
+ * @brief Evaluation of a top-level statement ran out of a budget set in
+ *        EvalOption, or was cancelled.
+ */
+class LimitError: public CompileError {
+  public:
+    LimitTag tag;
+
+    LimitError(pos_t pos, LimitTag tag) noexcept:
+        CompileError(pos, "LimitError: " + describe(tag)), tag(tag) {}
+
+  private:
+    static std::string describe(LimitTag tag) {
+        switch (tag) {
+        case LimitTag::kSteps:
+            return "Too many reduction steps.";
+        case LimitTag::kBytes:
+            return "Too many live bytes.";
+        case LimitTag::kDepth:
+            return "Evaluation nested too deep.";
+        default:
+            return "Evaluation cancelled.";
+        }
+    }
+};
+
 }  // namespace yacis::analysis
 
 #endif  // YACIS_ANALYSIS_ERROR_HPP_
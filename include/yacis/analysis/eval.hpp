@@ -1,11 +1,35 @@
 #ifndef YACIS_ANALYSIS_EVAL_HPP_
 #define YACIS_ANALYSIS_EVAL_HPP_
 
+#include <algorithm>
 #include <any>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "yacis/analysis/arena.hpp"
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/depend.hpp"
+#include "yacis/analysis/error.hpp"
+#include "yacis/analysis/jit.hpp"
+#include "yacis/analysis/memo.hpp"
+#include "yacis/analysis/option.hpp"
+#include "yacis/analysis/pool.hpp"
+#include "yacis/analysis/profile.hpp"
+#include "yacis/analysis/replace.hpp"
+#include "yacis/analysis/stats.hpp"
+#include "yacis/analysis/trace.hpp"
 #include "yacis/analysis/type.hpp"
 #include "yacis/analysis/yac_obj.hpp"
 #include "yacis/ast/node.hpp"
@@ -16,159 +40,479 @@ namespace internal {
 
 class YacNegate: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(-val);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val = force((*context)[0]).val;
+        return {WrapNegate()(val), nullptr};
     }
 };
 
 class YacAdd: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 + val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {WrapPlus()(val1, val2), nullptr};
     }
 };
 
 class YacSub: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 - val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {WrapMinus()(val1, val2), nullptr};
     }
 };
 
 class YacMul: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 * val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {WrapMultiplies()(val1, val2), nullptr};
     }
 };
 
 class YacDiv: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 / val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 / val2, nullptr};
     }
 };
 
 class YacMod: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 % val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 % val2, nullptr};
     }
 };
 
 class YacEq: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 == val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 == val2, nullptr};
     }
 };
 
 class YacNeq: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 != val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 != val2, nullptr};
     }
 };
 
 class YacLt: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 < val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 < val2, nullptr};
     }
 };
 
 class YacGt: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 > val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 > val2, nullptr};
     }
 };
 
 class YacLeq: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 <= val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 <= val2, nullptr};
     }
 };
 
 class YacGeq: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 >= val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 >= val2, nullptr};
     }
 };
 
 class YacAnd: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 && val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 && val2, nullptr};
     }
 };
 
 class YacOr: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val1 = YacVal::from(context->index(1)->val).val;
-        auto val2 = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(val1 || val2);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = force((*context)[0]).val;
+        auto val2 = force((*context)[1]).val;
+        return {val1 || val2, nullptr};
     }
 };
 
 class YacNot: public YacObj {
   public:
-    ObjRc eval(const Context& context) const override {
-        auto val = YacVal::from(context->index(0)->val).val;
-        return std::make_shared<YacVal>(!val);
+    Value step(Context& context, const YacObj*&) const override {
+        auto val = force((*context)[0]).val;
+        return {!val, nullptr};
     }
 };
 
-inline const std::vector<ObjRc> init_global_vec{
-    std::make_shared<YacFunc>(1, std::make_shared<YacNegate>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacAdd>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacSub>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacMul>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacDiv>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacMod>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacEq>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacNeq>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacLt>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacGt>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacLeq>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacGeq>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacAnd>()),
-    std::make_shared<YacFunc>(2, std::make_shared<YacOr>()),
-    std::make_shared<YacFunc>(1, std::make_shared<YacNot>()),
+/**
+ * @brief Return the body of builtin op, which takes its arguments from the
+ *        frame.
+ */
+inline ObjRc make_builtin_body(BuiltinOp op) {
+    switch (op) {
+    case BuiltinOp::kNegate:
+        return std::make_shared<YacNegate>();
+    case BuiltinOp::kAdd:
+        return std::make_shared<YacAdd>();
+    case BuiltinOp::kSub:
+        return std::make_shared<YacSub>();
+    case BuiltinOp::kMul:
+        return std::make_shared<YacMul>();
+    case BuiltinOp::kDiv:
+        return std::make_shared<YacDiv>();
+    case BuiltinOp::kMod:
+        return std::make_shared<YacMod>();
+    case BuiltinOp::kEq:
+        return std::make_shared<YacEq>();
+    case BuiltinOp::kNeq:
+        return std::make_shared<YacNeq>();
+    case BuiltinOp::kLt:
+        return std::make_shared<YacLt>();
+    case BuiltinOp::kGt:
+        return std::make_shared<YacGt>();
+    case BuiltinOp::kLeq:
+        return std::make_shared<YacLeq>();
+    case BuiltinOp::kGeq:
+        return std::make_shared<YacGeq>();
+    case BuiltinOp::kAnd:
+        return std::make_shared<YacAnd>();
+    case BuiltinOp::kOr:
+        return std::make_shared<YacOr>();
+    case BuiltinOp::kNot:
+        return std::make_shared<YacNot>();
+    }
+    return nullptr;
+}
+
+inline const std::vector<Value> init_global_vec = [] {
+    std::vector<Value> vec;
+    for (auto&& builtin : builtins)
+        vec.push_back({0,
+                       std::make_shared<YacFunc>(
+                           builtin.arg_num, make_builtin_body(builtin.op))});
+    return vec;
+}();
+
+/**
+ * @brief Whether Op is defined on val1 and val2, so it can be computed ahead
+ *        of time in lazy mode. Division by zero and INT_MIN / -1 are not.
+ */
+template<typename Op>
+inline bool is_defined_on(int32_t val1, int32_t val2) {
+    if constexpr (std::is_same_v<Op, std::divides<int32_t>> ||
+                  std::is_same_v<Op, std::modulus<int32_t>>)
+        return val2 != 0 &&
+               !(val1 == std::numeric_limits<int32_t>::min() && val2 == -1);
+    return true;
+}
+
+/**
+ * @brief Inlined saturated call of an unary builtin.
+ */
+template<typename Op>
+class YacUnaryPrim: public YacObj {
+  public:
+    const ObjRc operand;
+
+    explicit YacUnaryPrim(ObjRc operand): operand(std::move(operand)) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        auto val = operand->eval(context).val;
+        return {static_cast<int32_t>(Op()(val)), nullptr};
+    }
+
+    /**
+     * @brief Compute the result right away if the operand is a known value,
+     *        so accumulating arguments do not build chains of thunks.
+     */
+    Value delayed(const ObjRc& self, const Context& context) const override {
+        auto val = delay(operand, context);
+        if (!val.obj) return {static_cast<int32_t>(Op()(val.val)), nullptr};
+        return YacObj::delayed(self, context);
+    }
+};
+
+/**
+ * @brief Inlined saturated call of a binary builtin.
+ */
+template<typename Op>
+class YacBinaryPrim: public YacObj {
+  public:
+    const ObjRc lhs;
+    const ObjRc rhs;
+
+    YacBinaryPrim(ObjRc lhs, ObjRc rhs):
+        lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        auto val1 = lhs->eval(context).val;
+        auto val2 = rhs->eval(context).val;
+        return {static_cast<int32_t>(Op()(val1, val2)), nullptr};
+    }
+
+    /**
+     * @brief Compute the result right away if both operands are known values
+     *        it is defined on, so accumulating arguments do not build chains
+     *        of thunks. Otherwise it is left to whoever forces it.
+     */
+    Value delayed(const ObjRc& self, const Context& context) const override {
+        auto val1 = delay(lhs, context);
+        if (!val1.obj) {
+            auto val2 = delay(rhs, context);
+            if (!val2.obj && is_defined_on<Op>(val1.val, val2.val))
+                return {static_cast<int32_t>(Op()(val1.val, val2.val)),
+                        nullptr};
+        }
+        return YacObj::delayed(self, context);
+    }
+};
+
+/**
+ * @brief Inlined saturated call of a binary builtin, whose left operand is
+ *        forked onto pool while the right one is evaluated.
+ */
+template<typename Op>
+class YacParBinaryPrim: public YacBinaryPrim<Op> {
+  public:
+    WorkPool* pool;  // should be observer_ptr
+
+    YacParBinaryPrim(ObjRc lhs, ObjRc rhs, WorkPool* pool):
+        YacBinaryPrim<Op>(std::move(lhs), std::move(rhs)), pool(pool) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        if (!pool->should_fork()) return YacBinaryPrim<Op>::step(context, tail);
+        Task task;
+        task.obj = this->lhs.get();
+        task.context = context;
+        pool->fork(task);
+        Value val2;
+        try {
+            val2 = this->rhs->eval(context);
+        } catch (...) {
+            pool->wait(task);
+            throw;
+        }
+        auto val1 = pool->join(task);
+        return {static_cast<int32_t>(Op()(val1.val, val2.val)), nullptr};
+    }
+};
+
+/**
+ * @brief Application whose arguments in forked, indices in ele, are forked
+ *        onto pool while the others are evaluated.
+ */
+class YacParAppl: public YacAppl {
+  public:
+    WorkPool* pool;  // should be observer_ptr
+    const std::vector<size_t> forked;
+
+    YacParAppl(std::vector<ObjRc> ele,
+               WorkPool* pool,
+               std::vector<size_t> forked):
+        YacAppl(std::move(ele), ObjKind::kOther),
+        pool(pool),
+        forked(std::move(forked)) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        if (!pool->should_fork()) return YacAppl::step(context, tail);
+        auto tasks = std::make_unique<Task[]>(forked.size());
+        for (size_t i = 0; i < forked.size(); ++i) {
+            tasks[i].obj = ele[forked[i]].get();
+            tasks[i].context = context;
+            pool->fork(tasks[i]);
+        }
+        std::vector<Value> values(ele.size());
+        try {
+            for (size_t i = 1, j = 0; i < ele.size(); ++i) {
+                if (j < forked.size() && forked[j] == i)
+                    ++j;
+                else
+                    values[i] = ele[i]->eval(context);
+            }
+        } catch (...) {
+            for (size_t i = 0; i < forked.size(); ++i) pool->wait(tasks[i]);
+            throw;
+        }
+        for (size_t i = 0; i < forked.size(); ++i) pool->wait(tasks[i]);
+        for (size_t i = 0; i < forked.size(); ++i)
+            values[forked[i]] = pool->join(tasks[i]);
+        return apply(context, tail, [&](size_t i) { return values[i]; });
+    }
 };
 
+using PrimFactory = ObjRc (*)(const std::vector<ObjRc>&, WorkPool*);
+
+template<typename Op>
+ObjRc make_unary_prim(const std::vector<ObjRc>& operands, WorkPool*) {
+    return std::make_shared<YacUnaryPrim<Op>>(operands[0]);
+}
+
+/**
+ * @brief Make a binary primitive node, which forks onto pool if it is not
+ *        null.
+ */
+template<typename Op>
+ObjRc make_binary_prim(const std::vector<ObjRc>& operands, WorkPool* pool) {
+    if (pool)
+        return std::make_shared<YacParBinaryPrim<Op>>(
+            operands[0], operands[1], pool);
+    return std::make_shared<YacBinaryPrim<Op>>(operands[0], operands[1]);
+}
+
+/**
+ * @brief Return the factory of primitive nodes of builtin op.
+ */
+inline PrimFactory prim_factory(BuiltinOp op) {
+    switch (op) {
+    case BuiltinOp::kNegate:
+        return make_unary_prim<WrapNegate>;
+    case BuiltinOp::kAdd:
+        return make_binary_prim<WrapPlus>;
+    case BuiltinOp::kSub:
+        return make_binary_prim<WrapMinus>;
+    case BuiltinOp::kMul:
+        return make_binary_prim<WrapMultiplies>;
+    case BuiltinOp::kDiv:
+        return make_binary_prim<std::divides<int32_t>>;
+    case BuiltinOp::kMod:
+        return make_binary_prim<std::modulus<int32_t>>;
+    case BuiltinOp::kEq:
+        return make_binary_prim<std::equal_to<int32_t>>;
+    case BuiltinOp::kNeq:
+        return make_binary_prim<std::not_equal_to<int32_t>>;
+    case BuiltinOp::kLt:
+        return make_binary_prim<std::less<int32_t>>;
+    case BuiltinOp::kGt:
+        return make_binary_prim<std::greater<int32_t>>;
+    case BuiltinOp::kLeq:
+        return make_binary_prim<std::less_equal<int32_t>>;
+    case BuiltinOp::kGeq:
+        return make_binary_prim<std::greater_equal<int32_t>>;
+    case BuiltinOp::kAnd:
+        return make_binary_prim<std::logical_and<int32_t>>;
+    case BuiltinOp::kOr:
+        return make_binary_prim<std::logical_or<int32_t>>;
+    case BuiltinOp::kNot:
+        return make_unary_prim<std::logical_not<int32_t>>;
+    }
+    return nullptr;
+}
+
 class EvalVisitor: public ast::BaseVisitor {
   public:
-    std::vector<ObjRc> global_vec = init_global_vec;
+    const EvalOption option;
+    std::vector<Value> global_vec = init_global_vec;
     std::vector<std::pair<int32_t, Type>> output;
+    Arena arena;  // runtime objects of each output, released after it
+    MemoTable memo_table;
+    Jit jit;
+    std::mutex jit_mutex;
+
+    // Top-level statement left to evaluate on threads.
+    struct Job {
+        const ast::BaseNode* node;     // should be observer_ptr, statement
+        ast::ValueAssignNode* assign;  // should be observer_ptr, null if output
+        size_t index;                  // global index defined, or in output
+        ObjRc obj;
+        std::vector<size_t> waits;  // jobs to finish before
+    };
+
+    std::vector<Dependency> graph;  // set by eval if statements are scheduled
+    std::vector<Job> jobs;
+    std::vector<size_t> global_jobs;  // user global index -> job
+
+    // Global index -> parameter number, of globals defined by lambdas.
+    std::map<size_t, size_t> known_arities;
+
+    std::set<size_t> thunk_globals;  // globals evaluated when first used
+
+    std::map<std::vector<intptr_t>, ObjRc> cons_table;  // see cons
+    std::set<const YacObj*> closed_objs;  // objects of closed code
+
+    std::unique_ptr<WorkPool> pool;  // null unless arguments are forked
+    std::unique_ptr<Budget> budget;  // null unless there is a limit
+    std::unique_ptr<Profiler> profiler;  // null unless profiling
+    std::unique_ptr<StatsCollector> stats;  // null unless counted
+
+    explicit EvalVisitor(EvalOption option = {}):
+        option(std::move(option)), memo_table(this->option.memo_capacity) {
+        if (this->option.fork_workers && !this->option.lazy)
+            pool = std::make_unique<WorkPool>(this->option.fork_workers);
+        if (this->option.max_steps || this->option.max_bytes ||
+            this->option.max_depth || this->option.cancel)
+            budget = std::make_unique<Budget>(this->option.max_steps,
+                                              this->option.max_bytes,
+                                              this->option.max_depth,
+                                              this->option.cancel);
+        if (this->option.profile)
+            profiler = std::make_unique<Profiler>(this->option.profile);
+        if (this->option.stats) stats = std::make_unique<StatsCollector>();
+    }
+
+    /**
+     * @brief Return whether top-level statements are scheduled on threads by
+     *        graph instead of evaluated in order.
+     */
+    [[nodiscard]] bool is_scheduled() const {
+        return option.threads != 1 && !option.lazy;
+    }
+
+    /**
+     * @brief Return whether global variables other than functions and
+     *        constants are evaluated when first used. Their thunks must not be
+     *        forced by several threads, and compiled functions need the values
+     *        of scalar globals ahead.
+     */
+    [[nodiscard]] bool is_deferred() const {
+        return option.lazy || (!is_scheduled() && !pool && !option.jit);
+    }
+
+    /**
+     * @brief Return whether evaluating p may take long, which is when it calls
+     *        anything but builtins. Only such arguments are worth forking.
+     */
+    static bool is_costly(std::unique_ptr<ast::BaseNode>& p) {
+        if (p->tag == ast::NodeTag::kCondExpr) {
+            for (auto&& i : p->children)
+                if (is_costly(i)) return true;
+            return false;
+        }
+        if (p->tag != ast::NodeTag::kApplExpr) return false;
+        auto& head = p->children[0];
+        if (head->tag != ast::NodeTag::kGlobal) return true;
+        auto index = ast::as<ast::GlobalNode>(head).index;
+        if (!saturated_builtin(index, p->children.size() - 1)) return true;
+        for (size_t i = 1; i < p->children.size(); ++i)
+            if (is_costly(p->children[i])) return true;
+        return false;
+    }
 
     std::any call(std::unique_ptr<ast::BaseNode>& p) {
         return p->accept(this);
@@ -184,16 +528,52 @@ class EvalVisitor: public ast::BaseVisitor {
         return std::any();
     }
 
+    /**
+     * @brief Return the object shared by code of key, which is made by make if
+     *        there is none yet. Keys consist of the node tag, its payload and
+     *        the shared objects of its children, so structurally equal code
+     *        gets the same object. Closed code is recorded if closed is set.
+     */
+    template<typename Make>
+    ObjRc cons(std::vector<intptr_t> key, bool closed, Make&& make) {
+        if (!option.cse) return make();
+        auto it = cons_table.find(key);
+        if (it != cons_table.end()) return it->second;
+        auto obj = make();
+        cons_table.emplace(std::move(key), obj);
+        if (closed) closed_objs.insert(obj.get());
+        return obj;
+    }
+
+    /**
+     * @brief Return whether closed computations are evaluated once and shared.
+     *        That takes a thunk, so it follows is_deferred.
+     */
+    [[nodiscard]] bool is_value_shared() const {
+        return option.cse && is_deferred();
+    }
+
     std::any visit(ast::ValNode& n) override {
-        return ret(std::make_shared<YacVal>(n.value));
+        return ret(cons({intptr_t(n.tag), n.value}, true, [&] {
+            return std::make_shared<YacVal>(n.value);
+        }));
     }
 
     std::any visit(ast::ArgNode& n) override {
-        return ret(std::make_shared<YacArg>(n.index));
+        return ret(cons({intptr_t(n.tag), intptr_t(n.index)}, false, [&] {
+            if (option.lazy)
+                return ObjRc(std::make_shared<YacLazyArg>(n.index));
+            return ObjRc(std::make_shared<YacArg>(n.index));
+        }));
     }
 
     std::any visit(ast::GlobalNode& n) override {
-        return ret(std::make_shared<YacGlobal>(&global_vec, n.index));
+        return ret(cons({intptr_t(n.tag), intptr_t(n.index)}, true, [&] {
+            if (option.lazy || thunk_globals.count(n.index))
+                return ObjRc(
+                    std::make_shared<YacLazyGlobal>(&global_vec, n.index));
+            return ObjRc(std::make_shared<YacGlobal>(&global_vec, n.index));
+        }));
     }
 
     std::any visit(ast::ApplExprNode& n) override {
@@ -201,44 +581,323 @@ class EvalVisitor: public ast::BaseVisitor {
         ele.reserve(n.children.size());
         for (auto&& i : n.children)
             ele.push_back(std::any_cast<const ObjRc>(call(i)));
-        return ret(std::make_shared<YacAppl>(std::move(ele)));
+
+        std::vector<intptr_t> key{intptr_t(n.tag)};
+        auto closed = true;
+        for (auto&& i : ele) {
+            key.push_back(reinterpret_cast<intptr_t>(i.get()));
+            closed = closed && closed_objs.count(i.get());
+        }
+        return ret(cons(std::move(key), closed, [&] {
+            auto obj = make_appl(n, std::move(ele));
+            if (closed && is_value_shared())
+                return ObjRc(std::make_shared<YacShared>(obj));
+            return obj;
+        }));
+    }
+
+    /**
+     * @brief Make the object of application n, whose children evaluate to
+     *        ele.
+     */
+    ObjRc make_appl(ast::ApplExprNode& n, std::vector<ObjRc> ele) {
+        // Fork all costly arguments but the last one, if there are two or
+        // more of them.
+        std::vector<size_t> forked;
+        if (pool)
+            for (size_t i = 1; i < n.children.size(); ++i)
+                if (is_costly(n.children[i])) forked.push_back(i);
+        if (!forked.empty()) forked.pop_back();
+
+        auto& head = n.children[0];
+        if (head->tag == ast::NodeTag::kGlobal) {
+            auto index = ast::as<ast::GlobalNode>(head).index;
+            if (const auto* builtin =
+                    saturated_builtin(index, ele.size() - 1)) {
+                ele.erase(ele.begin());
+                return prim_factory(builtin->op)(
+                    ele, forked.empty() ? nullptr : pool.get());
+            }
+            auto it = known_arities.find(index);
+            if (!option.lazy && forked.empty() && it != known_arities.end() &&
+                it->second == ele.size() - 1) {
+                ele.erase(ele.begin());
+                return std::make_shared<YacKnownCall>(
+                    &global_vec, index, std::move(ele));
+            }
+        }
+        if (option.lazy) return std::make_shared<YacLazyAppl>(std::move(ele));
+        if (!forked.empty())
+            return std::make_shared<YacParAppl>(
+                std::move(ele), pool.get(), std::move(forked));
+        return std::make_shared<YacAppl>(std::move(ele));
     }
 
     std::any visit(ast::CondExprNode& n) override {
-        return ret(std::make_shared<YacCond>(
-            std::any_cast<const ObjRc>(call(n.children[0])),
-            std::any_cast<const ObjRc>(call(n.children[1])),
-            std::any_cast<const ObjRc>(call(n.children[2]))));
+        auto if_obj = std::any_cast<const ObjRc>(call(n.children[0]));
+        auto then_obj = std::any_cast<const ObjRc>(call(n.children[1]));
+        auto else_obj = std::any_cast<const ObjRc>(call(n.children[2]));
+        auto closed = closed_objs.count(if_obj.get()) &&
+                      closed_objs.count(then_obj.get()) &&
+                      closed_objs.count(else_obj.get());
+        std::vector<intptr_t> key{intptr_t(n.tag),
+                                  reinterpret_cast<intptr_t>(if_obj.get()),
+                                  reinterpret_cast<intptr_t>(then_obj.get()),
+                                  reinterpret_cast<intptr_t>(else_obj.get())};
+        return ret(cons(std::move(key), closed, [&] {
+            ObjRc obj = std::make_shared<YacCond>(if_obj, then_obj, else_obj);
+            if (closed && is_value_shared())
+                return ObjRc(std::make_shared<YacShared>(obj));
+            return obj;
+        }));
     }
 
     std::any visit(ast::LambdaExprNode& n) override {
-        return ret(std::make_shared<YacFunc>(
-            n.children.size() - 1,
-            std::any_cast<const ObjRc>(call(n.children.back()))));
+        auto body = std::any_cast<const ObjRc>(call(n.children.back()));
+        auto param_num = n.children.size() - 1;
+        auto& captures = n.info.captures;
+        std::vector<intptr_t> key{intptr_t(n.tag),
+                                  intptr_t(param_num),
+                                  intptr_t(captures.size())};
+        for (auto i : captures) key.push_back(intptr_t(i));
+        key.push_back(reinterpret_cast<intptr_t>(body.get()));
+        return ret(cons(std::move(key), captures.empty(), [&] {
+            if (captures.empty()) return make_func(param_num, body);
+            return ObjRc(
+                std::make_shared<YacLambda>(param_num, captures, body));
+        }));
+    }
+
+    /**
+     * @brief Return whether calls to the global function defined by n should
+     *        be memoized.
+     */
+    bool is_memoized(ast::ValueAssignNode& n) const {
+        auto& name = ast::as<ast::VarNameNode>(n.children[0]).info.name;
+        if (option.lazy) return false;
+        if (!option.memoize_all && !option.memoize.count(name)) return false;
+        return is_scalar_function(n);
     }
 
     std::any visit(ast::ValueAssignNode& n) override {
-        global_vec.push_back(std::any_cast<const ObjRc>(call(n.children[1]))
-                                 ->eval(empty_context));
+        auto index = global_vec.size();
+        if (n.children[1]->tag == ast::NodeTag::kLambdaExpr)
+            known_arities[index] = n.children[1]->children.size() - 1;
+        auto obj = std::any_cast<const ObjRc>(call(n.children[1]));
+        if (is_memoized(n)) {
+            const auto& func =
+                YacFunc::from(static_cast<const YacConst&>(*obj).value);
+            obj = make_func(func.param_num,
+                            std::make_shared<YacMemo>(
+                                &memo_table, index, func.param_num, func.body));
+        }
+        auto tag = n.children[1]->tag;
+        if (profiler) {
+            auto id = profiler->add(
+                ast::as<ast::VarNameNode>(n.children[0]).info.name);
+            if (tag == ast::NodeTag::kLambdaExpr) {
+                const auto& func =
+                    YacFunc::from(static_cast<const YacConst&>(*obj).value);
+                obj = make_func(
+                    func.param_num,
+                    std::make_shared<YacProfiled>(id, false, func.body));
+            } else {
+                obj = std::make_shared<YacProfiled>(id, true, std::move(obj));
+            }
+        }
+        if (is_deferred() && tag != ast::NodeTag::kLambdaExpr &&
+            tag != ast::NodeTag::kVal) {
+            if (option.trace)
+                obj = std::make_shared<YacTraced>(
+                    option.trace,
+                    ast::as<ast::VarNameNode>(n.children[0]).info.name,
+                    n.m_begin.line,
+                    std::move(obj));
+            thunk_globals.insert(index);
+            global_vec.push_back(
+                {0, std::make_shared<YacThunk>(obj, empty_context, true)});
+        } else if (is_scheduled()) {
+            global_jobs.push_back(jobs.size());
+            add_job(n, &n, index, std::move(obj));
+            global_vec.emplace_back();
+        } else {
+            global_vec.push_back(define(n, index, obj));
+        }
         return std::any();
     }
 
     std::any visit(ast::OutputNode& n) override {
         auto result = std::any_cast<const ObjRc>(call(n.children[0]));
-        output.emplace_back(YacVal::from(result->eval(empty_context)).val,
-                            n.info.type);
+        if (profiler)
+            result = std::make_shared<YacProfiled>(
+                profiler->add("<output:" + std::to_string(n.m_begin.line) +
+                              ">"),
+                true,
+                std::move(result));
+        if (is_scheduled()) {
+            add_job(n, nullptr, output.size(), std::move(result));
+            output.emplace_back(0, n.info.type);
+            return std::any();
+        }
+        ArenaScope scope(&arena);
+        output.emplace_back(eval_output(n, result), n.info.type);
         return std::any();
     }
+
+    /**
+     * @brief Evaluate the output n from obj.
+     */
+    int32_t eval_output(const ast::BaseNode& n, const ObjRc& obj) {
+        auto line = std::to_string(n.m_begin.line);
+        TraceSpan span(option.trace,
+                       "<output:" + line + ">",
+                       "output",
+                       "\"line\":" + line);
+        return limited(n, [&] { return obj->eval(empty_context).val; });
+    }
+
+    /**
+     * @brief Return f(), turning a budget exceeded meanwhile into LimitError
+     *        at the statement n.
+     */
+    template<typename F>
+    static auto limited(const ast::BaseNode& n, F&& f) -> decltype(f()) {
+        try {
+            return f();
+        } catch (const LimitExceeded& e) {
+            throw LimitError(n.m_begin, e.tag);
+        }
+    }
+
+    /**
+     * @brief Evaluate the global variable defined by n, whose global index is
+     *        index, from obj. Global functions are compiled first if enabled,
+     *        unless there is a budget or a profile, which native code cannot
+     *        charge nor record.
+     */
+    Value define(ast::ValueAssignNode& n, size_t index, ObjRc obj) {
+        TraceSpan span(option.trace,
+                       ast::as<ast::VarNameNode>(n.children[0]).info.name,
+                       "define",
+                       "\"line\":" + std::to_string(n.m_begin.line));
+        if (option.jit && !option.lazy && !budget && !profiler &&
+            !is_memoized(n)) {
+            NativeFunc native;
+            {
+                std::lock_guard<std::mutex> lock(jit_mutex);
+                native = jit.compile(n, index, global_vec);
+            }
+            if (native) {
+                auto param_num = n.children[1]->children.size() - 1;
+                obj = make_func(param_num,
+                                std::make_shared<YacNative>(native, param_num));
+            }
+        }
+        return limited(n, [&] { return obj->eval(empty_context); });
+    }
+
+    /**
+     * @brief Add the next top-level statement as a job waiting for the jobs
+     *        defining the global variables it uses.
+     */
+    void add_job(const ast::BaseNode& n,
+                 ast::ValueAssignNode* assign,
+                 size_t index,
+                 ObjRc obj) {
+        std::vector<size_t> waits;
+        for (auto i : graph[jobs.size()].uses)
+            waits.push_back(global_jobs[i - init_global_vec.size()]);
+        jobs.push_back({&n, assign, index, std::move(obj), std::move(waits)});
+    }
+
+    void run_job(Job& job, Arena& thread_arena) {
+        if (job.assign) {
+            global_vec[job.index] = define(*job.assign, job.index, job.obj);
+        } else {
+            ArenaScope scope(&thread_arena);
+            output[job.index].first = eval_output(*job.node, job.obj);
+        }
+    }
+
+    /**
+     * @brief Evaluate jobs on threads. A job becomes ready once all jobs it
+     *        waits for are finished, and each thread takes the ready one first
+     *        in source order. Outputs get an arena of the thread, while global
+     *        variables outlive it and are allocated as usual.
+     */
+    void run_jobs() {
+        auto thread_num = option.threads;
+        if (!thread_num)
+            thread_num = std::max(std::thread::hardware_concurrency(), 1u);
+        thread_num = std::min(thread_num, jobs.size());
+
+        std::vector<size_t> wait_nums(jobs.size());
+        std::vector<std::vector<size_t>> waited_by(jobs.size());
+        std::set<size_t> ready;
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            wait_nums[i] = jobs[i].waits.size();
+            for (auto j : jobs[i].waits) waited_by[j].push_back(i);
+            if (!wait_nums[i]) ready.insert(i);
+        }
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t finished = 0;
+        std::exception_ptr error;
+        auto work = [&] {
+            BudgetScope budget_scope(budget.get());
+            ProfileScope profile_scope(profiler.get());
+            StatsScope stats_scope(stats.get());
+            Arena thread_arena;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                cond.wait(lock, [&] {
+                    return error || finished == jobs.size() || !ready.empty();
+                });
+                if (error || finished == jobs.size()) return;
+                auto i = *ready.begin();
+                ready.erase(ready.begin());
+                lock.unlock();
+                try {
+                    run_job(jobs[i], thread_arena);
+                } catch (...) {
+                    lock.lock();
+                    if (!error) error = std::current_exception();
+                    cond.notify_all();
+                    return;
+                }
+                lock.lock();
+                ++finished;
+                for (auto j : waited_by[i])
+                    if (!--wait_nums[j]) ready.insert(j);
+                cond.notify_all();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_num; ++i) threads.emplace_back(work);
+        if (thread_num) work();
+        for (auto&& i : threads) i.join();
+        jobs.clear();
+        if (error) std::rethrow_exception(error);
+    }
 };
 
 /**
  * @brief Analysis stage 3. Evaluate ast and output results.
  * @param root Root node of AST.
+ * @param option Evaluation options.
  */
 inline std::vector<std::pair<int32_t, Type>>
-eval(std::unique_ptr<ast::BaseNode>& root) {
-    EvalVisitor visitor;
+eval(std::unique_ptr<ast::BaseNode>& root, const EvalOption& option = {}) {
+    EvalVisitor visitor(option);
+    BudgetScope scope(visitor.budget.get());
+    ProfileScope profile_scope(visitor.profiler.get());
+    StatsScope stats_scope(visitor.stats.get());
+    if (visitor.is_scheduled()) visitor.graph = depend(root);
     visitor.call(root);
+    visitor.run_jobs();
+    if (option.stats) *option.stats = visitor.stats->get();
     return std::move(visitor.output);
 }
 
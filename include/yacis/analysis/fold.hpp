@@ -0,0 +1,202 @@
+#ifndef YACIS_ANALYSIS_FOLD_HPP_
+#define YACIS_ANALYSIS_FOLD_HPP_
+
+#include <any>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "yacis/analysis/replace.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+enum class FoldTag {
+    kAppl,   // builtin application with constant arguments
+    kCond,   // conditional expression with constant condition
+    kGlobal  // global variable folded into a constant
+};
+
+struct FoldRecord {
+    FoldTag tag;
+    ast::BaseNode::iterator_t pos;
+    int32_t value;  // folded value, or the condition of a pruned if
+};
+
+/**
+ * @brief Describe a fold record in the format of compile errors.
+ */
+inline std::string to_string(const FoldRecord& record) {
+    auto ret = std::to_string(record.pos.line) + ":" +
+               std::to_string(record.pos.byte_in_line) + " - ";
+    switch (record.tag) {
+    case FoldTag::kAppl:
+        return ret + "Folded application into " +
+               std::to_string(record.value) + ".";
+    case FoldTag::kCond:
+        return ret + "Pruned " + (record.value ? "else" : "then") +
+               "-expression of constant condition.";
+    case FoldTag::kGlobal:
+        return ret + "Folded variable into " + std::to_string(record.value) +
+               ".";
+    }
+    return ret;
+}
+
+namespace internal {
+
+/**
+ * @brief Compute builtin op on constant arguments. Return std::nullopt if the
+ *        result is undefined, which is left to run time. Arithmetic wraps
+ *        around like the evaluators do.
+ */
+inline std::optional<int32_t> fold_builtin(BuiltinOp op,
+                                           const std::vector<int32_t>& args) {
+    auto val1 = args[0];
+    auto val2 = args.size() > 1 ? args[1] : 0;
+    auto min = std::numeric_limits<int32_t>::min();
+    switch (op) {
+    case BuiltinOp::kNegate:
+        return WrapNegate()(val1);
+    case BuiltinOp::kAdd:
+        return WrapPlus()(val1, val2);
+    case BuiltinOp::kSub:
+        return WrapMinus()(val1, val2);
+    case BuiltinOp::kMul:
+        return WrapMultiplies()(val1, val2);
+    case BuiltinOp::kDiv:
+        if (!val2 || (val1 == min && val2 == -1)) return std::nullopt;
+        return val1 / val2;
+    case BuiltinOp::kMod:
+        if (!val2 || (val1 == min && val2 == -1)) return std::nullopt;
+        return val1 % val2;
+    case BuiltinOp::kEq:
+        return val1 == val2;
+    case BuiltinOp::kNeq:
+        return val1 != val2;
+    case BuiltinOp::kLt:
+        return val1 < val2;
+    case BuiltinOp::kGt:
+        return val1 > val2;
+    case BuiltinOp::kLeq:
+        return val1 <= val2;
+    case BuiltinOp::kGeq:
+        return val1 >= val2;
+    case BuiltinOp::kAnd:
+        return val1 && val2;
+    case BuiltinOp::kOr:
+        return val1 || val2;
+    case BuiltinOp::kNot:
+        return !val1;
+    }
+    return std::nullopt;
+}
+
+class FoldVisitor: public ast::BaseVisitor {
+  public:
+    std::map<size_t, int32_t> val_table;  // global index -> folded value
+    std::vector<FoldRecord> report;
+    std::unique_ptr<ast::BaseNode>* curr_node = nullptr;
+    size_t global_count = init_global_table.size();
+
+    void call(std::unique_ptr<ast::BaseNode>& p) {
+        auto temp = curr_node;
+        curr_node = &p;
+        p->accept(this);
+        curr_node = temp;
+    }
+
+    std::any visit(ast::BaseNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::GlobalNode& n) override {
+        auto it = val_table.find(n.index);
+        if (it != val_table.end())
+            *curr_node = std::make_unique<ast::ValNode>(it->second);
+        return std::any();
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        for (auto&& i : n.children) call(i);
+
+        auto& head = n.children[0];
+        if (head->tag != ast::NodeTag::kGlobal) return std::any();
+        auto index = ast::as<ast::GlobalNode>(head).index;
+        const auto* builtin = saturated_builtin(index, n.children.size() - 1);
+        if (!builtin) return std::any();
+
+        std::vector<int32_t> args;
+        for (size_t i = 1; i < n.children.size(); ++i) {
+            if (n.children[i]->tag != ast::NodeTag::kVal) return std::any();
+            args.push_back(ast::as<ast::ValNode>(n.children[i]).value);
+        }
+        auto result = fold_builtin(builtin->op, args);
+        if (!result) return std::any();
+
+        report.push_back({FoldTag::kAppl, n.m_begin, *result});
+        *curr_node = std::make_unique<ast::ValNode>(*result);
+        return std::any();
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        call(n.children[0]);
+        call(n.children[1]);
+        call(n.children[2]);
+
+        if (n.children[0]->tag != ast::NodeTag::kVal) return std::any();
+        auto cond = ast::as<ast::ValNode>(n.children[0]).value;
+        report.push_back({FoldTag::kCond, n.m_begin, cond});
+        auto branch = std::move(n.children[cond ? 1 : 2]);
+        *curr_node = std::move(branch);
+        return std::any();
+    }
+
+    std::any visit(ast::LambdaExprNode& n) override {
+        call(n.children.back());
+        return std::any();
+    }
+
+    std::any visit(ast::ValueAssignNode& n) override {
+        auto index = global_count++;
+        auto is_literal = n.children[1]->tag == ast::NodeTag::kVal;
+        call(n.children[1]);
+        if (n.children[1]->tag == ast::NodeTag::kVal) {
+            auto value = ast::as<ast::ValNode>(n.children[1]).value;
+            val_table[index] = value;
+            if (!is_literal)
+                report.push_back({FoldTag::kGlobal, n.m_begin, value});
+        }
+        return std::any();
+    }
+
+    std::any visit(ast::OutputNode& n) override {
+        call(n.children[0]);
+        return std::any();
+    }
+};
+
+/**
+ * @brief Analysis stage 2.5. Fold closed expressions made of constants and
+ *        builtins, propagate folded global variables into later uses and
+ *        prune if-expressions with constant conditions.
+ * @param root Root node of replaced AST.
+ * @return What has been folded.
+ */
+inline std::vector<FoldRecord> fold(std::unique_ptr<ast::BaseNode>& root) {
+    FoldVisitor visitor;
+    visitor.call(root);
+    return std::move(visitor.report);
+}
+
+}  // namespace internal
+
+using internal::fold;
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_FOLD_HPP_
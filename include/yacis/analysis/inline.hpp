@@ -0,0 +1,321 @@
+#ifndef YACIS_ANALYSIS_INLINE_HPP_
+#define YACIS_ANALYSIS_INLINE_HPP_
+
+#include <any>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "yacis/analysis/replace.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+namespace internal {
+
+template<typename T>
+std::unique_ptr<ast::BaseNode> copy_node(const T& n);
+
+/**
+ * @brief Return a deep copy of a node of replaced AST.
+ */
+inline std::unique_ptr<ast::BaseNode> clone(const ast::BaseNode& n) {
+    switch (n.tag) {
+    case ast::NodeTag::kVal:
+        return std::make_unique<ast::ValNode>(
+            static_cast<const ast::ValNode&>(n).value);
+    case ast::NodeTag::kArg:
+        return std::make_unique<ast::ArgNode>(
+            static_cast<const ast::ArgNode&>(n).index);
+    case ast::NodeTag::kGlobal:
+        return std::make_unique<ast::GlobalNode>(
+            static_cast<const ast::GlobalNode&>(n).index);
+    case ast::NodeTag::kApplExpr:
+        return copy_node(static_cast<const ast::ApplExprNode&>(n));
+    case ast::NodeTag::kCondExpr:
+        return copy_node(static_cast<const ast::CondExprNode&>(n));
+    case ast::NodeTag::kLambdaExpr:
+        return copy_node(static_cast<const ast::LambdaExprNode&>(n));
+    case ast::NodeTag::kLambdaParam:
+        return copy_node(static_cast<const ast::LambdaParamNode&>(n));
+    case ast::NodeTag::kVarName:
+        return copy_node(static_cast<const ast::VarNameNode&>(n));
+    case ast::NodeTag::kTypeName:
+        return copy_node(static_cast<const ast::TypeNameNode&>(n));
+    case ast::NodeTag::kType:
+        return copy_node(static_cast<const ast::TypeNode&>(n));
+    default:
+        return copy_node(n);
+    }
+}
+
+template<typename T>
+std::unique_ptr<ast::BaseNode> copy_node(const T& n) {
+    ast::BaseNode base;
+    base.m_begin = n.m_begin;
+    base.m_end = n.m_end;
+    std::unique_ptr<ast::BaseNode> ret;
+    if constexpr (std::is_same_v<T, ast::BaseNode>) {
+        ret = std::make_unique<ast::BaseNode>(std::move(base), n.tag);
+    } else {
+        auto node = std::make_unique<T>(std::move(base));
+        if constexpr (!std::is_same_v<T, ast::ApplExprNode> &&
+                      !std::is_same_v<T, ast::CondExprNode> &&
+                      !std::is_same_v<T, ast::LambdaParamNode> &&
+                      !std::is_same_v<T, ast::TypeNode>)
+            node->info = n.info;
+        ret = std::move(node);
+    }
+    for (auto&& i : n.children) ret->emplace_back(clone(*i));
+    return ret;
+}
+
+/**
+ * @brief Number of nodes of expression n, as the size of inlined code.
+ */
+inline size_t expr_size(const ast::BaseNode& n) {
+    if (n.tag == ast::NodeTag::kLambdaExpr)
+        return 1 + expr_size(*n.children.back());
+    size_t ret = 1;
+    for (auto&& i : n.children) ret += expr_size(*i);
+    return ret;
+}
+
+/**
+ * @brief Return whether expression n refers to global variable index.
+ */
+inline bool refers_to(const ast::BaseNode& n, size_t index) {
+    if (n.tag == ast::NodeTag::kGlobal)
+        return static_cast<const ast::GlobalNode&>(n).index == index;
+    if (n.tag == ast::NodeTag::kLambdaExpr)
+        return refers_to(*n.children.back(), index);
+    for (auto&& i : n.children)
+        if (refers_to(*i, index)) return true;
+    return false;
+}
+
+/**
+ * @brief Return whether evaluating n costs nothing and cannot fail, so it may
+ *        be duplicated or dropped.
+ */
+inline bool is_trivial(const ast::BaseNode& n) {
+    return n.tag == ast::NodeTag::kVal || n.tag == ast::NodeTag::kArg ||
+           n.tag == ast::NodeTag::kGlobal;
+}
+
+struct SlotUses {
+    size_t strict = 0;  // uses evaluated whenever the expression is
+    size_t other = 0;   // uses in branches or captured by lambdas
+};
+
+/**
+ * @brief Count uses of each slot of the frame expression n is evaluated in.
+ */
+inline void count_uses(const ast::BaseNode& n,
+                       bool strict,
+                       std::vector<SlotUses>& uses) {
+    switch (n.tag) {
+    case ast::NodeTag::kArg: {
+        auto& slot = uses[static_cast<const ast::ArgNode&>(n).index];
+        ++(strict ? slot.strict : slot.other);
+        return;
+    }
+    case ast::NodeTag::kCondExpr:
+        count_uses(*n.children[0], strict, uses);
+        count_uses(*n.children[1], false, uses);
+        count_uses(*n.children[2], false, uses);
+        return;
+    case ast::NodeTag::kLambdaExpr:
+        // Its body is evaluated in a frame of its own.
+        for (auto i : static_cast<const ast::LambdaExprNode&>(n).info.captures)
+            ++uses[i].other;
+        return;
+    default:
+        for (auto&& i : n.children) count_uses(*i, strict, uses);
+    }
+}
+
+/**
+ * @brief Replace every argument i in p by a copy of slots[i], which is an
+ *        expression of the frame p is moved into. Captures of lambdas in p are
+ *        redirected to that frame, or dropped if what they capture turns into
+ *        a value or a global variable.
+ */
+inline void substitute(std::unique_ptr<ast::BaseNode>& p,
+                       const std::vector<const ast::BaseNode*>& slots) {
+    if (p->tag == ast::NodeTag::kArg) {
+        p = clone(*slots[ast::as<ast::ArgNode>(p).index]);
+        return;
+    }
+    if (p->tag != ast::NodeTag::kLambdaExpr) {
+        for (auto&& i : p->children) substitute(i, slots);
+        return;
+    }
+
+    auto& lambda = ast::as<ast::LambdaExprNode>(p);
+    auto param_num = lambda.children.size() - 1;
+    std::vector<std::unique_ptr<ast::BaseNode>> inner;
+    for (size_t i = 0; i < param_num; ++i)
+        inner.push_back(std::make_unique<ast::ArgNode>(i));
+    std::vector<size_t> captures;
+    for (auto i : lambda.info.captures) {
+        const auto& slot = *slots[i];
+        if (slot.tag == ast::NodeTag::kArg) {
+            inner.push_back(
+                std::make_unique<ast::ArgNode>(param_num + captures.size()));
+            captures.push_back(static_cast<const ast::ArgNode&>(slot).index);
+        } else {
+            inner.push_back(clone(slot));  // trivial, see count_uses
+        }
+    }
+    lambda.info.captures = std::move(captures);
+
+    std::vector<const ast::BaseNode*> inner_slots;
+    for (auto&& i : inner) inner_slots.push_back(i.get());
+    substitute(lambda.children.back(), inner_slots);
+}
+
+class InlineVisitor: public ast::BaseVisitor {
+  public:
+    const size_t size_limit;
+    const std::set<std::string>& kept;  // names of globals never inlined
+    std::map<size_t, const ast::LambdaExprNode*> inline_table;
+    std::unique_ptr<ast::BaseNode>* curr_node = nullptr;
+    size_t global_count = init_global_table.size();
+    size_t inline_count = 0;
+
+    InlineVisitor(size_t size_limit, const std::set<std::string>& kept):
+        size_limit(size_limit), kept(kept) {}
+
+    void call(std::unique_ptr<ast::BaseNode>& p) {
+        auto temp = curr_node;
+        curr_node = &p;
+        p->accept(this);
+        curr_node = temp;
+    }
+
+    std::any visit(ast::BaseNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        for (auto&& i : n.children) call(i);
+
+        auto& head = n.children[0];
+        const ast::LambdaExprNode* lambda = nullptr;
+        if (head->tag == ast::NodeTag::kLambdaExpr) {
+            lambda = &ast::as<ast::LambdaExprNode>(head);
+        } else if (head->tag == ast::NodeTag::kGlobal) {
+            auto it = inline_table.find(ast::as<ast::GlobalNode>(head).index);
+            if (it != inline_table.end()) lambda = it->second;
+        }
+        if (!lambda) return std::any();
+        auto param_num = lambda->children.size() - 1;
+        if (n.children.size() - 1 < param_num) return std::any();
+
+        // Arguments are evaluated exactly once before the call, which is kept
+        // unless they are trivial.
+        auto& captures = lambda->info.captures;
+        std::vector<SlotUses> uses(param_num + captures.size());
+        count_uses(*lambda->children.back(), true, uses);
+        for (size_t i = 0; i < param_num; ++i) {
+            if (is_trivial(*n.children[i + 1])) continue;
+            if (uses[i].strict != 1 || uses[i].other) return std::any();
+        }
+
+        std::vector<std::unique_ptr<ast::BaseNode>> capture_args;
+        std::vector<const ast::BaseNode*> slots;
+        for (size_t i = 0; i < param_num; ++i)
+            slots.push_back(n.children[i + 1].get());
+        for (auto i : captures) {
+            capture_args.push_back(std::make_unique<ast::ArgNode>(i));
+            slots.push_back(capture_args.back().get());
+        }
+        auto body = clone(*lambda->children.back());
+        substitute(body, slots);
+        ++inline_count;
+
+        // Over-applied, apply the rest to the result.
+        if (n.children.size() - 1 > param_num) {
+            if (body->tag != ast::NodeTag::kApplExpr) {
+                ast::BaseNode base;
+                base.m_begin = n.m_begin;
+                base.m_end = n.m_end;
+                auto appl =
+                    std::make_unique<ast::ApplExprNode>(std::move(base));
+                appl->emplace_back(std::move(body));
+                body = std::move(appl);
+            }
+            for (size_t i = param_num + 1; i < n.children.size(); ++i)
+                body->emplace_back(std::move(n.children[i]));
+        }
+
+        // Arguments may bring in new calls to inline, e.g. lambdas applied in
+        // the body.
+        *curr_node = std::move(body);
+        call(*curr_node);
+        return std::any();
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        call(n.children[0]);
+        call(n.children[1]);
+        call(n.children[2]);
+        return std::any();
+    }
+
+    std::any visit(ast::LambdaExprNode& n) override {
+        call(n.children.back());
+        return std::any();
+    }
+
+    std::any visit(ast::ValueAssignNode& n) override {
+        auto index = global_count++;
+        call(n.children[1]);
+
+        auto& name = ast::as<ast::VarNameNode>(n.children[0]).info.name;
+        auto& value = n.children[1];
+        if (value->tag != ast::NodeTag::kLambdaExpr || kept.count(name))
+            return std::any();
+        auto& body = *value->children.back();
+        if (expr_size(body) <= size_limit && !refers_to(body, index))
+            inline_table[index] = &ast::as<ast::LambdaExprNode>(value);
+        return std::any();
+    }
+
+    std::any visit(ast::OutputNode& n) override {
+        call(n.children[0]);
+        return std::any();
+    }
+};
+
+/**
+ * @brief Analysis stage 2.4. Inline calls to small global functions that are
+ *        not recursive, as well as applications of lambda expressions.
+ *        Arguments are substituted into the body, unless one that is not
+ *        trivial would be evaluated more or less than once.
+ * @param root Root node of replaced AST.
+ * @param size_limit Max number of nodes of the body of an inlined global.
+ * @param kept Names of global functions never inlined.
+ * @return Number of calls inlined.
+ */
+inline size_t inline_calls(std::unique_ptr<ast::BaseNode>& root,
+                           size_t size_limit,
+                           const std::set<std::string>& kept = {}) {
+    InlineVisitor visitor(size_limit, kept);
+    visitor.call(root);
+    return visitor.inline_count;
+}
+
+}  // namespace internal
+
+using internal::inline_calls;
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_INLINE_HPP_
@@ -0,0 +1,397 @@
+#ifndef YACIS_ANALYSIS_JIT_HPP_
+#define YACIS_ANALYSIS_JIT_HPP_
+
+#include <any>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define YACIS_HAS_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "yacis/analysis/fold.hpp"
+#include "yacis/analysis/type.hpp"
+#include "yacis/analysis/yac_obj.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+/**
+ * @brief Native code of a global function. Arguments are passed as an array
+ *        of values.
+ */
+using NativeFunc = int32_t (*)(const int32_t*);
+
+/**
+ * @brief Return whether the global variable defined by n is a function whose
+ *        parameters and result are all Int, Bool or Char.
+ */
+inline bool is_scalar_function(ast::ValueAssignNode& n) {
+    if (n.children[1]->tag != ast::NodeTag::kLambdaExpr) return false;
+    auto& type = n.info.type;
+    if (type.ele.size() != n.children[1]->children.size()) return false;
+    for (auto&& i : type.ele)
+        if (i.tag == TypeTag::kFunction) return false;
+    return true;
+}
+
+/**
+ * @brief Body of a global function compiled by Jit.
+ */
+class YacNative: public YacObj {
+  public:
+    static constexpr size_t max_params = 16;
+
+    const NativeFunc func;
+    const size_t arg_num;
+
+    YacNative(NativeFunc func, size_t arg_num): func(func), arg_num(arg_num) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        std::array<int32_t, max_params> args{};
+        for (size_t i = 0; i < arg_num; ++i) args[i] = (*context)[i].val;
+        return {func(args.data()), nullptr};
+    }
+};
+
+namespace internal {
+
+/**
+ * @brief Generate x86-64 code of a global function. Generated functions follow
+ *        System V ABI with the argument array in rdi, which is kept in rbx.
+ *        Values are computed in eax, with temporaries on the stack. Clears ok
+ *        on anything but scalar arithmetic, conditions and saturated calls to
+ *        builtins, itself and other compiled functions.
+ */
+class JitVisitor: public ast::BaseVisitor {
+  public:
+    const std::vector<Value>* global_vec;  // should be observer_ptr
+    const std::map<size_t, std::pair<NativeFunc, size_t>>* funcs;
+    const size_t self;  // global index of the function being compiled
+    size_t param_num = 0;
+    size_t body_start = 0;
+    std::vector<uint8_t> code;
+    bool is_tail = false;
+    bool ok = true;
+
+    JitVisitor(const std::vector<Value>* global_vec,
+               const std::map<size_t, std::pair<NativeFunc, size_t>>* funcs,
+               size_t self):
+        global_vec(global_vec), funcs(funcs), self(self) {}
+
+    void call(std::unique_ptr<ast::BaseNode>& p, bool tail = false) {
+        auto temp = is_tail;
+        is_tail = tail;
+        if (ok) p->accept(this);
+        is_tail = temp;
+    }
+
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    void emit32(uint32_t val) {
+        for (size_t i = 0; i < 4; ++i) code.push_back(val >> (i * 8) & 0xffu);
+    }
+
+    void emit64(uint64_t val) {
+        for (size_t i = 0; i < 8; ++i) code.push_back(val >> (i * 8) & 0xffu);
+    }
+
+    /**
+     * @brief Set the rel32 operand at pos to jump to target.
+     */
+    void patch(size_t pos, size_t target) {
+        auto rel = static_cast<uint32_t>(target - (pos + 4));
+        for (size_t i = 0; i < 4; ++i) code[pos + i] = rel >> (i * 8) & 0xffu;
+    }
+
+    void compile(ast::LambdaExprNode& n) {
+        param_num = n.children.size() - 1;
+        if (param_num > YacNative::max_params) {
+            ok = false;
+            return;
+        }
+        emit({0x53});              // push rbx
+        emit({0x48, 0x89, 0xfb});  // mov rbx, rdi
+        body_start = code.size();
+        call(n.children.back(), true);
+        emit({0x5b});  // pop rbx
+        emit({0xc3});  // ret
+    }
+
+    std::any visit(ast::BaseNode&) override {
+        ok = false;
+        return std::any();
+    }
+
+    std::any visit(ast::ValNode& n) override {
+        emit({0xb8});  // mov eax, imm32
+        emit32(n.value);
+        return std::any();
+    }
+
+    std::any visit(ast::ArgNode& n) override {
+        emit({0x8b, 0x83});  // mov eax, [rbx + disp32]
+        emit32(n.index * 4);
+        return std::any();
+    }
+
+    std::any visit(ast::GlobalNode& n) override {
+        // Globals used are defined before, only scalars can be inlined.
+        if (n.index >= self || (*global_vec)[n.index].obj) {
+            ok = false;
+            return std::any();
+        }
+        emit({0xb8});  // mov eax, imm32
+        emit32((*global_vec)[n.index].val);
+        return std::any();
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        auto& head = n.children[0];
+        auto arg_num = n.children.size() - 1;
+        if (head->tag != ast::NodeTag::kGlobal) {
+            ok = false;
+            return std::any();
+        }
+        auto index = ast::as<ast::GlobalNode>(head).index;
+        if (const auto* builtin = saturated_builtin(index, arg_num)) {
+            emit_builtin(n, builtin->op);
+        } else if (index == self && arg_num == param_num) {
+            if (is_tail)
+                emit_tail_call(n);
+            else
+                emit_call(n, nullptr);
+        } else if (auto it = funcs->find(index);
+                   it != funcs->end() && it->second.second == arg_num) {
+            emit_call(n, it->second.first);
+        } else {
+            ok = false;
+        }
+        return std::any();
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        call(n.children[0]);
+        emit({0x85, 0xc0});  // test eax, eax
+        emit({0x0f, 0x84});  // jz else
+        auto if_jump = code.size();
+        emit32(0);
+        call(n.children[1], is_tail);
+        emit({0xe9});  // jmp end
+        auto then_jump = code.size();
+        emit32(0);
+        patch(if_jump, code.size());
+        call(n.children[2], is_tail);
+        patch(then_jump, code.size());
+        return std::any();
+    }
+
+  private:
+    /**
+     * @brief Evaluate arguments of n into a new area on the stack and return
+     *        its size.
+     */
+    uint32_t emit_args(ast::ApplExprNode& n) {
+        auto arg_num = n.children.size() - 1;
+        auto size = static_cast<uint32_t>((arg_num * 4 + 15) / 16 * 16);
+        emit({0x48, 0x81, 0xec});  // sub rsp, imm32
+        emit32(size);
+        for (size_t i = 0; i < arg_num; ++i) {
+            call(n.children[i + 1]);
+            emit({0x89, 0x84, 0x24});  // mov [rsp + disp32], eax
+            emit32(i * 4);
+        }
+        return size;
+    }
+
+    /**
+     * @brief Call func, or the function being compiled if it is null.
+     */
+    void emit_call(ast::ApplExprNode& n, NativeFunc func) {
+        auto size = emit_args(n);
+        emit({0x48, 0x89, 0xe7});  // mov rdi, rsp
+        if (func) {
+            emit({0x48, 0xb8});  // mov rax, imm64
+            emit64(reinterpret_cast<uint64_t>(func));
+            emit({0xff, 0xd0});  // call rax
+        } else {
+            emit({0xe8});  // call rel32
+            emit32(0);
+            patch(code.size() - 4, 0);
+        }
+        emit({0x48, 0x81, 0xc4});  // add rsp, imm32
+        emit32(size);
+    }
+
+    /**
+     * @brief Overwrite the arguments of the current call and jump back to the
+     *        start of the body. The argument array is owned by the caller and
+     *        only read by this call, so it can be reused.
+     */
+    void emit_tail_call(ast::ApplExprNode& n) {
+        auto size = emit_args(n);
+        for (size_t i = 0; i < param_num; ++i) {
+            emit({0x8b, 0x84, 0x24});  // mov eax, [rsp + disp32]
+            emit32(i * 4);
+            emit({0x89, 0x83});  // mov [rbx + disp32], eax
+            emit32(i * 4);
+        }
+        emit({0x48, 0x81, 0xc4});  // add rsp, imm32
+        emit32(size);
+        emit({0xe9});  // jmp body
+        emit32(0);
+        patch(code.size() - 4, body_start);
+    }
+
+    void emit_builtin(ast::ApplExprNode& n, BuiltinOp op) {
+        call(n.children[1]);
+        if (n.children.size() > 2) {
+            emit({0x50});  // push rax
+            call(n.children[2]);
+            emit({0x89, 0xc1});  // mov ecx, eax
+            emit({0x58});        // pop rax
+        }
+        auto setcc = [this](uint8_t cc) {
+            emit({0x39, 0xc8});        // cmp eax, ecx
+            emit({0x0f, cc, 0xc0});    // setcc al
+            emit({0x0f, 0xb6, 0xc0});  // movzx eax, al
+        };
+        switch (op) {
+        case BuiltinOp::kNegate:
+            emit({0xf7, 0xd8});  // neg eax
+            break;
+        case BuiltinOp::kAdd:
+            emit({0x01, 0xc8});  // add eax, ecx
+            break;
+        case BuiltinOp::kSub:
+            emit({0x29, 0xc8});  // sub eax, ecx
+            break;
+        case BuiltinOp::kMul:
+            emit({0x0f, 0xaf, 0xc1});  // imul eax, ecx
+            break;
+        case BuiltinOp::kDiv:
+            emit({0x99});        // cdq
+            emit({0xf7, 0xf9});  // idiv ecx
+            break;
+        case BuiltinOp::kMod:
+            emit({0x99});        // cdq
+            emit({0xf7, 0xf9});  // idiv ecx
+            emit({0x89, 0xd0});  // mov eax, edx
+            break;
+        case BuiltinOp::kEq:
+            setcc(0x94);  // sete
+            break;
+        case BuiltinOp::kNeq:
+            setcc(0x95);  // setne
+            break;
+        case BuiltinOp::kLt:
+            setcc(0x9c);  // setl
+            break;
+        case BuiltinOp::kGt:
+            setcc(0x9f);  // setg
+            break;
+        case BuiltinOp::kLeq:
+            setcc(0x9e);  // setle
+            break;
+        case BuiltinOp::kGeq:
+            setcc(0x9d);  // setge
+            break;
+        case BuiltinOp::kAnd:
+        case BuiltinOp::kOr:
+            emit({0x85, 0xc0});        // test eax, eax
+            emit({0x0f, 0x95, 0xc0});  // setne al
+            emit({0x85, 0xc9});        // test ecx, ecx
+            emit({0x0f, 0x95, 0xc1});  // setne cl
+            if (op == BuiltinOp::kAnd)
+                emit({0x20, 0xc8});  // and al, cl
+            else
+                emit({0x08, 0xc8});  // or al, cl
+            emit({0x0f, 0xb6, 0xc0});  // movzx eax, al
+            break;
+        case BuiltinOp::kNot:
+            emit({0x85, 0xc0});        // test eax, eax
+            emit({0x0f, 0x94, 0xc0});  // sete al
+            emit({0x0f, 0xb6, 0xc0});  // movzx eax, al
+            break;
+        }
+    }
+};
+
+}  // namespace internal
+
+/**
+ * @brief Compiler of scalar global functions into executable memory, which is
+ *        released with this object.
+ */
+class Jit {
+  public:
+    Jit() = default;
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    ~Jit() {
+#ifdef YACIS_HAS_JIT
+        for (auto&& [ptr, size] : pages) munmap(ptr, size);
+#endif
+    }
+
+    /**
+     * @brief Compile the global function defined by n, whose global index is
+     *        index. Globals before it must have been evaluated. Return nullptr
+     *        if it is not supported, in which case it should be evaluated as
+     *        usual.
+     */
+    NativeFunc compile(ast::ValueAssignNode& n, size_t index,
+                       const std::vector<Value>& global_vec) {
+#ifdef YACIS_HAS_JIT
+        if (!is_scalar_function(n)) return nullptr;
+        internal::JitVisitor visitor(&global_vec, &funcs, index);
+        visitor.compile(ast::as<ast::LambdaExprNode>(n.children[1]));
+        if (!visitor.ok) return nullptr;
+        auto func = install(visitor.code);
+        if (func) funcs[index] = {func, visitor.param_num};
+        return func;
+#else
+        (void)n;
+        (void)index;
+        (void)global_vec;
+        return nullptr;
+#endif
+    }
+
+  private:
+    std::map<size_t, std::pair<NativeFunc, size_t>> funcs;
+    std::vector<std::pair<void*, size_t>> pages;
+
+#ifdef YACIS_HAS_JIT
+    NativeFunc install(const std::vector<uint8_t>& code) {
+        auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto size = (code.size() + page_size - 1) / page_size * page_size;
+        auto ptr = mmap(nullptr,
+                        size,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1,
+                        0);
+        if (ptr == MAP_FAILED) return nullptr;
+        pages.emplace_back(ptr, size);
+        std::memcpy(ptr, code.data(), code.size());
+        if (mprotect(ptr, size, PROT_READ | PROT_EXEC)) return nullptr;
+        return reinterpret_cast<NativeFunc>(ptr);
+    }
+#endif
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_JIT_HPP_
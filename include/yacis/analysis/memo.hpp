@@ -0,0 +1,80 @@
+#ifndef YACIS_ANALYSIS_MEMO_HPP_
+#define YACIS_ANALYSIS_MEMO_HPP_
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace yacis::analysis {
+
+/**
+ * @brief Bounded cache of function results. A key is the global index of a
+ *        function followed by its arguments. The least recently used entry is
+ *        evicted when the table is full. It can be shared between threads.
+ */
+class MemoTable {
+  public:
+    using Key = std::vector<int32_t>;
+
+    const size_t capacity;
+
+    explicit MemoTable(size_t capacity): capacity(capacity) {}
+
+    [[nodiscard]] size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return map.size();
+    }
+
+    /**
+     * @brief Return the cached result of key and mark it as recently used.
+     */
+    std::optional<int32_t> find(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(key);
+        if (it == map.end()) return std::nullopt;
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->second;
+    }
+
+    void insert(const Key& key, int32_t val) {
+        if (!capacity) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = map.find(key);
+        if (it != map.end()) {
+            it->second->second = val;
+            lru.splice(lru.begin(), lru, it->second);
+            return;
+        }
+        if (map.size() == capacity) {
+            map.erase(lru.back().first);
+            lru.pop_back();
+        }
+        lru.emplace_front(key, val);
+        map.emplace(key, lru.begin());
+    }
+
+  private:
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept {
+            size_t hash = key.size();
+            for (auto i : key)
+                hash ^= static_cast<uint32_t>(i) + 0x9e3779b9u + (hash << 6u) +
+                        (hash >> 2u);
+            return hash;
+        }
+    };
+
+    using Entry = std::pair<Key, int32_t>;
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map;
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_MEMO_HPP_
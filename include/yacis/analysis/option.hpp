@@ -0,0 +1,118 @@
+#ifndef YACIS_ANALYSIS_OPTION_HPP_
+#define YACIS_ANALYSIS_OPTION_HPP_
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yacis::analysis {
+
+struct FoldRecord;
+struct Profile;
+struct RuntimeStats;
+class Trace;
+
+enum class Engine {
+    kTree,     // tree-walking evaluator over YacObj graphs
+    kBytecode  // bytecode compiler and stack vm
+};
+
+struct EvalOption {
+    Engine engine = Engine::kTree;
+
+    // Inline calls to global functions that are not recursive and whose body
+    // has at most inline_limit nodes, as well as applications of lambda
+    // expressions, before fold. 0 to disable. Functions named in memoize are
+    // never inlined.
+    size_t inline_limit = 16;
+
+    // Run fold between replace and eval. If fold_report is set, what has been
+    // folded is written to it.
+    bool fold = true;
+    std::vector<FoldRecord>* fold_report = nullptr;  // should be observer_ptr
+
+    // Remove definitions of global variables that no output depends on, even
+    // indirectly, after fold. Independently, the tree engine evaluates the
+    // remaining global variables other than functions and constants when
+    // first used, unless threads, fork_workers or jit is set.
+    bool eliminate_dead = true;
+
+    // Share structurally equal code between all its occurrences. Closed
+    // applications and conditions are also evaluated at most once, when first
+    // needed, under the same conditions as global variables above. Tree engine
+    // only.
+    bool cse = true;
+
+    // Call by need. Arguments and global variables are evaluated when first
+    // used instead of before, at most once. Memoization and JIT are disabled
+    // as they are strict in arguments. Tree engine only.
+    bool lazy = false;
+
+    // Number of threads evaluating top-level statements, 0 for one per core.
+    // With more than one, a global variable or an output is evaluated as soon
+    // as the global variables it uses are, so independent ones run at the
+    // same time. Results are kept in source order. Ignored in lazy mode,
+    // where thunks may be shared between statements. Tree engine only.
+    size_t threads = 1;
+
+    // Number of workers of a work-stealing pool, 0 for none. If there is a
+    // pool, calls with two or more arguments that call functions other than
+    // builtins fork all but one of them onto the pool, while the queue of
+    // the thread is short. Reference counting gets atomic once there are
+    // other threads, which roughly halves single-thread speed, so it only
+    // pays off on several cores. Ignored in lazy mode. Tree engine only.
+    size_t fork_workers = 0;
+
+    // Memoize calls to global functions whose parameters and result are all
+    // Int, Bool or Char, either all of them or those named in memoize. A
+    // memoized function gives up tail calls into its own body. Tree engine
+    // only.
+    bool memoize_all = false;
+    std::set<std::string> memoize;
+    size_t memo_capacity = 1u << 16u;  // max cached results, LRU evicted
+
+    // Compile global functions whose parameters and result are all Int, Bool
+    // or Char to native code, if they only call builtins, themselves and other
+    // compiled functions. Only on x86-64 Linux, ignored elsewhere. Memoized
+    // functions are not compiled. Tree engine only.
+    bool jit = false;
+
+    // Budgets of compile_to_output, 0 for none: reduction steps, live bytes
+    // of runtime objects and depth of nested evaluation. Running out of any
+    // of them, or cancel being set by another thread meanwhile, throws
+    // LimitError at the statement being evaluated, which for a global
+    // variable evaluated when first used is the one using it. Steps and
+    // cancel are checked every Budget::check_interval steps. Objects in the
+    // arena of an output stay live until it is done. Under any budget, the
+    // tree engine also stops nesting before the native stack runs out, as if
+    // max_depth were reached. JIT is disabled under a budget.
+    size_t max_steps = 0;
+    size_t max_bytes = 0;
+    size_t max_depth = 0;
+    const std::atomic<bool>* cancel = nullptr;  // should be observer_ptr
+
+    // If set, the tree engine profiles evaluation into it: calls, inclusive
+    // and exclusive time and allocations of each global definition and each
+    // output, and call stacks for flame graphs. Calls inlined before are
+    // counted in their callers, set inline_limit to 0 to see them. A tail
+    // call replaces the caller on the stack, and arguments forked onto other
+    // threads start stacks of their own. JIT is disabled while profiling.
+    Profile* profile = nullptr;  // should be observer_ptr
+
+    // If set, the tree engine counts into it what evaluation allocates by
+    // kind, peak live allocations and bytes, the largest frame and the
+    // deepest nesting of eval.
+    RuntimeStats* stats = nullptr;  // should be observer_ptr
+
+    // If set, compile_to_output, compile_to_asm and compile_to_c record into
+    // it a timeline of their passes and of evaluating each global variable
+    // and output, on the thread evaluating it. A global variable evaluated
+    // when first used is nested in the statement using it. See
+    // Trace::to_json.
+    Trace* trace = nullptr;  // should be observer_ptr
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_OPTION_HPP_
@@ -0,0 +1,202 @@
+#ifndef YACIS_ANALYSIS_POOL_HPP_
+#define YACIS_ANALYSIS_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "yacis/analysis/arena.hpp"
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/profile.hpp"
+#include "yacis/analysis/stats.hpp"
+#include "yacis/analysis/yac_obj.hpp"
+
+namespace yacis::analysis {
+
+/**
+ * @brief Evaluation of an object forked onto a WorkPool.
+ */
+struct Task {
+    const YacObj* obj = nullptr;  // should be observer_ptr
+    Context context;
+    Value result;
+    std::exception_ptr error;
+    std::atomic<bool> done{false};
+    // Of the thread forking it.
+    Budget* budget = curr_budget;
+    Profiler* profiler = curr_recorder ? curr_recorder->profiler : nullptr;
+    StatsCollector* stats = curr_stats;
+
+    void run() noexcept {
+        BudgetScope scope(budget);
+        ProfileScope profile_scope(profiler);
+        StatsScope stats_scope(stats);
+        try {
+            result = obj->eval(context);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        context.reset();
+        done.store(true, std::memory_order_release);
+    }
+};
+
+/**
+ * @brief Work-stealing pool. Each worker pushes and pops forked tasks at the
+ *        back of its own queue while idle workers steal from the front, where
+ *        the largest tasks are. Threads outside the pool share one queue.
+ *
+ *        Forking is only worthwhile while the queue of the thread is short,
+ *        otherwise there is enough work to steal and tasks should be
+ *        evaluated inline, see should_fork.
+ */
+class WorkPool {
+  public:
+    static constexpr size_t max_pending = 2;
+
+    explicit WorkPool(size_t worker_num) {
+        for (size_t i = 0; i <= worker_num; ++i)
+            queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 1; i <= worker_num; ++i)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            stop = true;
+        }
+        idle.notify_all();
+        for (auto&& i : workers) i.join();
+    }
+
+    [[nodiscard]] bool should_fork() const noexcept {
+        return local_queue().size.load(std::memory_order_relaxed) <
+               max_pending;
+    }
+
+    /**
+     * @brief Make task available to other threads. It must be joined before it
+     *        is destroyed.
+     */
+    void fork(Task& task) {
+        auto& queue = local_queue();
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(&task);
+            ++queue.size;
+        }
+        ++pending;
+        { std::lock_guard<std::mutex> lock(idle_mutex); }
+        idle.notify_one();
+    }
+
+    /**
+     * @brief Wait for task to finish. It is run by this thread if nobody has
+     *        taken it, otherwise other tasks are run meanwhile. Exceptions
+     *        thrown by it are left in task.error.
+     */
+    void wait(Task& task) {
+        if (take(local_queue(), &task)) {
+            task.run();
+            return;
+        }
+        while (!task.done.load(std::memory_order_acquire)) {
+            if (auto stolen = steal()) {
+                // It may belong to another output, keep it out of our arena.
+                ArenaScope scope(nullptr);
+                stolen->run();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * @brief Wait for task and rethrow its exception if any.
+     */
+    Value join(Task& task) {
+        wait(task);
+        if (task.error) std::rethrow_exception(task.error);
+        return task.result;
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task*> tasks;
+        std::atomic<size_t> size{0};
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;  // 0 for non-pool threads
+    std::vector<std::thread> workers;
+    std::atomic<size_t> pending{0};
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    bool stop = false;
+
+    inline static thread_local const WorkPool* curr_pool = nullptr;
+    inline static thread_local size_t curr_queue = 0;
+
+    [[nodiscard]] Queue& local_queue() const noexcept {
+        return *queues[curr_pool == this ? curr_queue : 0];
+    }
+
+    /**
+     * @brief Remove task from queue if it is still there.
+     */
+    bool take(Queue& queue, Task* task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        auto it = std::find(queue.tasks.rbegin(), queue.tasks.rend(), task);
+        if (it == queue.tasks.rend()) return false;
+        queue.tasks.erase(std::next(it).base());
+        --queue.size;
+        --pending;
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest task of any queue, or nullptr if there is none.
+     */
+    Task* steal() {
+        for (size_t i = 0; i < queues.size(); ++i) {
+            auto& queue = *queues[(curr_queue + 1 + i) % queues.size()];
+            if (!queue.size.load(std::memory_order_relaxed)) continue;
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) continue;
+            auto task = queue.tasks.front();
+            queue.tasks.pop_front();
+            --queue.size;
+            --pending;
+            return task;
+        }
+        return nullptr;
+    }
+
+    void work(size_t index) {
+        curr_pool = this;
+        curr_queue = index;
+        while (true) {
+            if (auto task = steal()) {
+                task->run();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            idle.wait(lock, [this] { return stop || pending; });
+            if (stop) return;
+        }
+    }
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_POOL_HPP_
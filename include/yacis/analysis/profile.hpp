@@ -0,0 +1,302 @@
+#ifndef YACIS_ANALYSIS_PROFILE_HPP_
+#define YACIS_ANALYSIS_PROFILE_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace yacis::analysis {
+
+/**
+ * @brief Statistics of a global definition or an output. Times are in
+ *        nanoseconds. Inclusive time counts recursive calls once, exclusive
+ *        time and allocations are those of its own body.
+ */
+struct ProfileEntry {
+    std::string name;
+    size_t calls = 0;
+    uint64_t inclusive_ns = 0;
+    uint64_t exclusive_ns = 0;
+    size_t alloc_num = 0;
+    size_t alloc_bytes = 0;
+};
+
+/**
+ * @brief Result of profiling an evaluation, see EvalOption::profile.
+ */
+struct Profile {
+    std::vector<ProfileEntry> entries;
+    // Call stacks joined by ';', root first -> exclusive nanoseconds.
+    std::map<std::string, uint64_t> stacks;
+
+    /**
+     * @brief Return a table of entries that have been called, by exclusive
+     *        time, longest first.
+     */
+    [[nodiscard]] std::string report() const {
+        std::vector<const ProfileEntry*> sorted;
+        size_t width = 8;
+        for (auto&& i : entries) {
+            if (!i.calls) continue;
+            sorted.push_back(&i);
+            width = std::max(width, i.name.size());
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](auto lhs, auto rhs) {
+            return lhs->exclusive_ns > rhs->exclusive_ns;
+        });
+
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << std::left
+            << std::setw(width) << "name" << std::right << std::setw(12)
+            << "calls" << std::setw(12) << "incl ms" << std::setw(12)
+            << "excl ms" << std::setw(12) << "allocs" << std::setw(14)
+            << "bytes" << '\n';
+        for (auto i : sorted)
+            out << std::left << std::setw(width) << i->name << std::right
+                << std::setw(12) << i->calls << std::setw(12)
+                << i->inclusive_ns / 1e6 << std::setw(12)
+                << i->exclusive_ns / 1e6 << std::setw(12) << i->alloc_num
+                << std::setw(14) << i->alloc_bytes << '\n';
+        return out.str();
+    }
+
+    /**
+     * @brief Return stacks in the folded format of flame graph tools, one
+     *        stack per line followed by its weight in nanoseconds.
+     */
+    [[nodiscard]] std::string folded() const {
+        std::string out;
+        for (auto&& [stack, ns] : stacks)
+            if (ns) out += stack + ' ' + std::to_string(ns) + '\n';
+        return out;
+    }
+};
+
+/**
+ * @brief Profile shared by all threads of an evaluation. Each thread records
+ *        into a ProfileRecorder of its own, merged into it when done.
+ */
+class Profiler {
+  public:
+    Profile* profile;  // should be observer_ptr
+
+    explicit Profiler(Profile* profile): profile(profile) {
+        *profile = Profile();
+    }
+
+    /**
+     * @brief Add an entry named name and return its id.
+     */
+    size_t add(std::string name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        profile->entries.push_back({std::move(name)});
+        return profile->entries.size() - 1;
+    }
+
+    std::string name(size_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return profile->entries[id].name;
+    }
+
+    void merge(const std::vector<ProfileEntry>& entries,
+               const std::map<std::string, uint64_t>& stacks) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            auto& entry = profile->entries[i];
+            entry.calls += entries[i].calls;
+            entry.inclusive_ns += entries[i].inclusive_ns;
+            entry.exclusive_ns += entries[i].exclusive_ns;
+            entry.alloc_num += entries[i].alloc_num;
+            entry.alloc_bytes += entries[i].alloc_bytes;
+        }
+        for (auto&& [stack, ns] : stacks) profile->stacks[stack] += ns;
+    }
+
+  private:
+    std::mutex mutex;
+};
+
+/**
+ * @brief Shadow call stack of a thread. A frame is entered when the body of a
+ *        profiled function starts and left when the eval it started in
+ *        returns, or when it makes a tail call to another profiled function,
+ *        which replaces it.
+ */
+class ProfileRecorder {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr size_t max_stack_depth = 64;
+
+    Profiler* profiler;  // should be observer_ptr
+    size_t base = 0;     // frames below belong to enclosing evals
+
+    explicit ProfileRecorder(Profiler* profiler):
+        profiler(profiler), nodes(1) {}
+
+    ProfileRecorder(const ProfileRecorder&) = delete;
+    ProfileRecorder& operator=(const ProfileRecorder&) = delete;
+
+    void enter(size_t id) {
+        leave_to(base);
+        auto now = clock::now();
+        if (id >= entries.size()) {
+            entries.resize(id + 1);
+            active.resize(id + 1);
+        }
+        ++entries[id].calls;
+        ++active[id];
+        // Direct recursions are folded into one node, and stacks deeper than
+        // max_stack_depth into their last node.
+        auto node = frames.empty() ? 0 : frames.back().node;
+        if (!node || (nodes[node].id != id &&
+                      nodes[node].depth < max_stack_depth)) {
+            auto [it, is_new] = nodes[node].children.emplace(id, nodes.size());
+            auto child = it->second;
+            if (is_new)
+                nodes.push_back({id, node, nodes[node].depth + 1, {}, 0});
+            node = child;
+        }
+        frames.push_back({id, node, now, 0});
+    }
+
+    [[nodiscard]] size_t frames_size() const noexcept {
+        return frames.size();
+    }
+
+    /**
+     * @brief Leave frames until there are size of them.
+     */
+    void leave_to(size_t size) {
+        if (frames.size() <= size) return;
+        auto now = clock::now();
+        while (frames.size() > size) {
+            auto frame = frames.back();
+            frames.pop_back();
+            auto time = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - frame.start)
+                    .count());
+            auto self = time - std::min(time, frame.child_ns);
+            entries[frame.id].exclusive_ns += self;
+            nodes[frame.node].self_ns += self;
+            if (!--active[frame.id]) entries[frame.id].inclusive_ns += time;
+            if (!frames.empty()) frames.back().child_ns += time;
+        }
+    }
+
+    void allocated(size_t bytes) noexcept {
+        if (frames.empty()) return;
+        auto& entry = entries[frames.back().id];
+        ++entry.alloc_num;
+        entry.alloc_bytes += bytes;
+    }
+
+    /**
+     * @brief Leave all frames and merge what has been recorded into profiler.
+     */
+    void flush() {
+        leave_to(0);
+        std::map<std::string, uint64_t> stacks;
+        std::vector<std::string> paths(nodes.size());
+        // Parents are created before their children.
+        for (size_t i = 1; i < nodes.size(); ++i) {
+            auto& parent = paths[nodes[i].parent];
+            paths[i] = (parent.empty() ? "" : parent + ';') +
+                       profiler->name(nodes[i].id);
+            stacks[paths[i]] += nodes[i].self_ns;
+        }
+        profiler->merge(entries, stacks);
+    }
+
+  private:
+    struct Frame {
+        size_t id;
+        size_t node;
+        clock::time_point start;
+        uint64_t child_ns;  // inclusive time of callees
+    };
+
+    // Node of the call tree, 0 being the root.
+    struct Node {
+        size_t id = 0;
+        size_t parent = 0;
+        size_t depth = 0;
+        std::map<size_t, size_t> children;  // entry id -> node
+        uint64_t self_ns = 0;
+    };
+
+    std::vector<Frame> frames;
+    std::vector<Node> nodes;
+    std::vector<ProfileEntry> entries;  // by id, names are left empty
+    std::vector<size_t> active;         // frames of each id on the stack
+};
+
+/**
+ * @brief Recorder of evaluation in this thread. Null means not profiled.
+ */
+inline thread_local ProfileRecorder* curr_recorder = nullptr;
+
+/**
+ * @brief Record evaluation in this thread into profiler during the lifetime
+ *        of this object, unless it already is. Does nothing if profiler is
+ *        null.
+ */
+class ProfileScope {
+  public:
+    explicit ProfileScope(Profiler* profiler): prev(curr_recorder) {
+        if (prev && prev->profiler == profiler) return;
+        if (profiler) recorder = std::make_unique<ProfileRecorder>(profiler);
+        curr_recorder = recorder.get();
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        if (recorder) recorder->flush();
+        curr_recorder = prev;
+    }
+
+  private:
+    ProfileRecorder* prev;  // should be observer_ptr
+    std::unique_ptr<ProfileRecorder> recorder;
+};
+
+/**
+ * @brief Delimit the frames entered by an eval during the lifetime of this
+ *        object. Does nothing if recorder is null.
+ */
+class ProfileGuard {
+  public:
+    explicit ProfileGuard(ProfileRecorder* recorder) noexcept:
+        recorder(recorder) {
+        if (!recorder) return;
+        prev_base = recorder->base;
+        recorder->base = recorder->frames_size();
+    }
+
+    ProfileGuard(const ProfileGuard&) = delete;
+    ProfileGuard& operator=(const ProfileGuard&) = delete;
+
+    ~ProfileGuard() {
+        if (!recorder) return;
+        recorder->leave_to(recorder->base);
+        recorder->base = prev_base;
+    }
+
+  private:
+    ProfileRecorder* recorder;  // should be observer_ptr
+    size_t prev_base = 0;
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_PROFILE_HPP_
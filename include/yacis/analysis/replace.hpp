@@ -2,7 +2,12 @@
 #define YACIS_ANALYSIS_REPLACE_HPP_
 
 #include <any>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 #include "yacis/analysis/symbol_table.hpp"
 #include "yacis/ast/node.hpp"
@@ -11,22 +16,107 @@ namespace yacis::analysis {
 
 namespace internal {
 
-inline const std::map<std::string, size_t> init_global_table{
-    {"negate", 0},  // - (unary)
-    {"add", 1},     // +
-    {"sub", 2},     // - (binary)
-    {"mul", 3},     // *
-    {"div", 4},     // /
-    {"mod", 5},     // %
-    {"eq", 6},      // ==
-    {"neq", 7},     // !=
-    {"lt", 8},      // <
-    {"gt", 9},      // >
-    {"leq", 10},    // <=
-    {"geq", 11},    // >=
-    {"and", 12},    // &&
-    {"or", 13},     // ||
-    {"not", 14}     // !
+enum class BuiltinOp {
+    kNegate,  // - (unary)
+    kAdd,     // +
+    kSub,     // - (binary)
+    kMul,     // *
+    kDiv,     // /
+    kMod,     // %
+    kEq,      // ==
+    kNeq,     // !=
+    kLt,      // <
+    kGt,      // >
+    kLeq,     // <=
+    kGeq,     // >=
+    kAnd,     // &&
+    kOr,      // ||
+    kNot      // !
+};
+
+struct Builtin {
+    std::string name;
+    size_t arg_num;
+    BuiltinOp op;
+};
+
+/**
+ * @brief Builtin functions, in the order of their global indices. Backends
+ *        switch on op, so a builtin is added here and in those switches.
+ */
+inline const std::vector<Builtin> builtins{
+    {"negate", 1, BuiltinOp::kNegate},
+    {"add", 2, BuiltinOp::kAdd},
+    {"sub", 2, BuiltinOp::kSub},
+    {"mul", 2, BuiltinOp::kMul},
+    {"div", 2, BuiltinOp::kDiv},
+    {"mod", 2, BuiltinOp::kMod},
+    {"eq", 2, BuiltinOp::kEq},
+    {"neq", 2, BuiltinOp::kNeq},
+    {"lt", 2, BuiltinOp::kLt},
+    {"gt", 2, BuiltinOp::kGt},
+    {"leq", 2, BuiltinOp::kLeq},
+    {"geq", 2, BuiltinOp::kGeq},
+    {"and", 2, BuiltinOp::kAnd},
+    {"or", 2, BuiltinOp::kOr},
+    {"not", 1, BuiltinOp::kNot},
+};
+
+/**
+ * @brief Return the builtin saturated by a call to global index with arg_num
+ *        arguments, or null if there is none.
+ */
+inline const Builtin* saturated_builtin(size_t index, size_t arg_num) {
+    if (index >= builtins.size() || builtins[index].arg_num != arg_num)
+        return nullptr;
+    return &builtins[index];
+}
+
+/**
+ * @brief Arithmetic of builtins on Int, which wraps around on overflow. It is
+ *        done on uint32_t, as signed overflow is undefined.
+ */
+struct WrapNegate {
+    int32_t operator()(int32_t val) const noexcept {
+        return static_cast<int32_t>(0u - static_cast<uint32_t>(val));
+    }
+};
+
+struct WrapPlus {
+    int32_t operator()(int32_t lhs, int32_t rhs) const noexcept {
+        return static_cast<int32_t>(static_cast<uint32_t>(lhs) +
+                                    static_cast<uint32_t>(rhs));
+    }
+};
+
+struct WrapMinus {
+    int32_t operator()(int32_t lhs, int32_t rhs) const noexcept {
+        return static_cast<int32_t>(static_cast<uint32_t>(lhs) -
+                                    static_cast<uint32_t>(rhs));
+    }
+};
+
+struct WrapMultiplies {
+    int32_t operator()(int32_t lhs, int32_t rhs) const noexcept {
+        return static_cast<int32_t>(static_cast<uint32_t>(lhs) *
+                                    static_cast<uint32_t>(rhs));
+    }
+};
+
+inline const std::map<std::string, size_t> init_global_table = [] {
+    std::map<std::string, size_t> table;
+    for (size_t i = 0; i < builtins.size(); ++i) table[builtins[i].name] = i;
+    return table;
+}();
+
+/**
+ * @brief Frame layout of a lambda. A frame holds the parameters followed by
+ *        the captured variables.
+ */
+struct LambdaScope {
+    ast::LambdaExprNode* node;  // should be observer_ptr
+    size_t param_num;
+    std::map<std::string, size_t> slot_table;
 };
 
 class ReplaceVisitor: public ast::BaseVisitor {
@@ -35,11 +125,9 @@ class ReplaceVisitor: public ast::BaseVisitor {
         std::make_shared<SymbolTable<int32_t>>();
     std::shared_ptr<SymbolTable<size_t>> global_table =
         std::make_shared<SymbolTable<size_t>>(init_global_table);
-    std::shared_ptr<SymbolTable<size_t>> arg_table =
-        std::make_shared<SymbolTable<size_t>>();
+    std::vector<LambdaScope> lambda_scopes;
     std::unique_ptr<ast::BaseNode>* curr_node = nullptr;
     size_t global_count = init_global_table.size();
-    size_t arg_count = 0;
 
     void call(std::unique_ptr<ast::BaseNode>& p) {
         auto temp = curr_node;
@@ -48,6 +136,26 @@ class ReplaceVisitor: public ast::BaseVisitor {
         curr_node = temp;
     }
 
+    /**
+     * @brief Return the slot of given argument in the frame of
+     *        lambda_scopes[depth]. Variables of enclosing lambdas are captured
+     *        on the way. Return std::nullopt if name is not an argument.
+     */
+    std::optional<size_t> resolve_arg(const std::string& name, size_t depth) {
+        auto& scope = lambda_scopes[depth];
+        auto it = scope.slot_table.find(name);
+        if (it != scope.slot_table.end()) return it->second;
+        if (depth == 0) return std::nullopt;
+
+        auto outer_slot = resolve_arg(name, depth - 1);
+        if (!outer_slot) return std::nullopt;
+        auto& captures = scope.node->info.captures;
+        auto slot = scope.param_num + captures.size();
+        captures.push_back(*outer_slot);
+        scope.slot_table[name] = slot;
+        return slot;
+    }
+
     std::any visit(ast::BaseNode& n) override {
         for (auto&& i : n.children) call(i);
         return std::any();
@@ -70,9 +178,11 @@ class ReplaceVisitor: public ast::BaseVisitor {
 
     std::any visit(ast::VarNameNode& n) override {
         auto& name = n.info.name;
-        if (arg_table->contains(name))
-            *curr_node = std::make_unique<ast::ArgNode>(arg_count - 1 -
-                                                        (*arg_table)[name]);
+        std::optional<size_t> slot;
+        if (!lambda_scopes.empty())
+            slot = resolve_arg(name, lambda_scopes.size() - 1);
+        if (slot)
+            *curr_node = std::make_unique<ast::ArgNode>(*slot);
         else if (val_table->contains(name))
             *curr_node = std::make_unique<ast::ValNode>((*val_table)[name]);
         else
@@ -93,17 +203,17 @@ class ReplaceVisitor: public ast::BaseVisitor {
         return std::any();
     }
 
-    std::any visit(ast::LambdaParamNode& n) override {
-        auto& name = ast::as<ast::VarNameNode>(n.children[0]).info.name;
-        (*arg_table)[name] = arg_count++;
-        return std::any();
-    }
-
     std::any visit(ast::LambdaExprNode& n) override {
-        arg_table = arg_table->new_child();
-        for (auto&& i : n.children) call(i);
-        arg_table = arg_table->parent;
-        arg_count -= n.children.size() - 1;
+        auto param_num = n.children.size() - 1;
+        n.info.captures.clear();
+        lambda_scopes.push_back({&n, param_num, {}});
+        for (size_t i = 0; i < param_num; ++i) {
+            auto& param = n.children[i]->children[0];
+            auto& name = ast::as<ast::VarNameNode>(param).info.name;
+            lambda_scopes.back().slot_table[name] = i;
+        }
+        call(n.children.back());
+        lambda_scopes.pop_back();
         return std::any();
     }
 
@@ -126,6 +236,8 @@ class ReplaceVisitor: public ast::BaseVisitor {
 
 /**
  * @brief Analysis stage 2. Replace constants, arguments and global variables.
+ *        Arguments become frame slots and each lambda records the variables
+ *        it captures from enclosing lambdas.
  * @param root Root node of AST.
  */
 inline void replace(std::unique_ptr<ast::BaseNode>& root) {
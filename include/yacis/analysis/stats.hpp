@@ -0,0 +1,168 @@
+#ifndef YACIS_ANALYSIS_STATS_HPP_
+#define YACIS_ANALYSIS_STATS_HPP_
+
+#include <atomic>
+#include <cstddef>
+
+namespace yacis::analysis {
+
+/**
+ * @brief Counters of an evaluation, see EvalOption::stats. Code objects such
+ *        as values and applications are built once before evaluation, only
+ *        what is allocated while evaluating is counted.
+ */
+struct RuntimeStats {
+    size_t frames = 0;    // frames of calls and closures
+    size_t partials = 0;  // functions partially applied
+    size_t closures = 0;  // lambdas capturing values
+    size_t thunks = 0;    // arguments delayed in lazy mode
+    size_t allocs = 0;    // allocations of any kind, frames included
+    size_t alloc_bytes = 0;
+    size_t peak_live_allocs = 0;  // objects in arenas live until reset
+    size_t peak_live_bytes = 0;
+    size_t max_frame_size = 0;  // slots of the largest frame
+    size_t max_depth = 0;       // deepest nesting of eval in a thread
+};
+
+enum class AllocKind { kFrame, kPartial, kClosure, kThunk };
+
+/**
+ * @brief Counters shared by all threads of an evaluation.
+ */
+class StatsCollector {
+  public:
+    void count(AllocKind kind) noexcept {
+        kinds[static_cast<size_t>(kind)].fetch_add(1,
+                                                   std::memory_order_relaxed);
+    }
+
+    void frame(size_t size) noexcept {
+        count(AllocKind::kFrame);
+        raise(max_frame_size, size);
+    }
+
+    void allocated(size_t bytes) noexcept {
+        allocs.fetch_add(1, std::memory_order_relaxed);
+        alloc_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        raise(peak_live_allocs,
+              live_allocs.fetch_add(1, std::memory_order_relaxed) + 1);
+        raise(peak_live_bytes,
+              live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+
+    void released(size_t num, size_t bytes) noexcept {
+        live_allocs.fetch_sub(num, std::memory_order_relaxed);
+        live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    void depth(size_t depth) noexcept {
+        raise(max_depth, depth);
+    }
+
+    [[nodiscard]] RuntimeStats get() const noexcept {
+        auto load = [](const std::atomic<size_t>& counter) {
+            return counter.load(std::memory_order_relaxed);
+        };
+        RuntimeStats stats;
+        stats.frames = load(kinds[static_cast<size_t>(AllocKind::kFrame)]);
+        stats.partials = load(kinds[static_cast<size_t>(AllocKind::kPartial)]);
+        stats.closures = load(kinds[static_cast<size_t>(AllocKind::kClosure)]);
+        stats.thunks = load(kinds[static_cast<size_t>(AllocKind::kThunk)]);
+        stats.allocs = load(allocs);
+        stats.alloc_bytes = load(alloc_bytes);
+        stats.peak_live_allocs = load(peak_live_allocs);
+        stats.peak_live_bytes = load(peak_live_bytes);
+        stats.max_frame_size = load(max_frame_size);
+        stats.max_depth = load(max_depth);
+        return stats;
+    }
+
+  private:
+    std::atomic<size_t> kinds[4] = {};
+    std::atomic<size_t> allocs{0};
+    std::atomic<size_t> alloc_bytes{0};
+    std::atomic<size_t> live_allocs{0};
+    std::atomic<size_t> live_bytes{0};
+    std::atomic<size_t> peak_live_allocs{0};
+    std::atomic<size_t> peak_live_bytes{0};
+    std::atomic<size_t> max_frame_size{0};
+    std::atomic<size_t> max_depth{0};
+
+    static void raise(std::atomic<size_t>& max, size_t value) noexcept {
+        auto curr = max.load(std::memory_order_relaxed);
+        while (curr < value &&
+               !max.compare_exchange_weak(
+                   curr, value, std::memory_order_relaxed)) {}
+    }
+};
+
+/**
+ * @brief Collector of evaluation in this thread. Null means not counted.
+ */
+inline thread_local StatsCollector* curr_stats = nullptr;
+inline thread_local size_t stats_depth = 0;
+
+/**
+ * @brief Count an allocation of kind in curr_stats if any.
+ */
+inline void count_alloc(AllocKind kind) noexcept {
+    if (curr_stats) curr_stats->count(kind);
+}
+
+/**
+ * @brief Count a frame of size slots in curr_stats if any.
+ */
+inline void count_frame(size_t size) noexcept {
+    if (curr_stats) curr_stats->frame(size);
+}
+
+/**
+ * @brief Set curr_stats during the lifetime of this object. Depth counted for
+ *        another collector is put aside meanwhile.
+ */
+class StatsScope {
+  public:
+    explicit StatsScope(StatsCollector* stats) noexcept:
+        stats(stats), prev(curr_stats), prev_depth(stats_depth) {
+        if (stats != prev) stats_depth = 0;
+        curr_stats = stats;
+    }
+
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+
+    ~StatsScope() {
+        curr_stats = prev;
+        if (stats != prev) stats_depth = prev_depth;
+    }
+
+  private:
+    StatsCollector* stats;  // should be observer_ptr
+    StatsCollector* prev;   // should be observer_ptr
+    size_t prev_depth;
+};
+
+/**
+ * @brief Count a nested evaluation in stats during the lifetime of this
+ *        object. Does nothing if stats is null.
+ */
+class StatsGuard {
+  public:
+    explicit StatsGuard(StatsCollector* stats) noexcept: stats(stats) {
+        if (stats) stats->depth(++stats_depth);
+    }
+
+    StatsGuard(const StatsGuard&) = delete;
+    StatsGuard& operator=(const StatsGuard&) = delete;
+
+    ~StatsGuard() {
+        if (stats) --stats_depth;
+    }
+
+  private:
+    StatsCollector* stats;  // should be observer_ptr
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_STATS_HPP_
@@ -0,0 +1,140 @@
+#ifndef YACIS_ANALYSIS_TRACE_HPP_
+#define YACIS_ANALYSIS_TRACE_HPP_
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace yacis::analysis {
+
+/**
+ * @brief Timeline of compile passes and evaluation of top-level statements,
+ *        see EvalOption::trace. Events may be recorded by several threads.
+ */
+class Trace {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    struct Event {
+        std::string name;
+        std::string category;
+        double ts;   // microseconds since the trace was created
+        double dur;  // microseconds
+        size_t tid;  // threads are numbered in order of their first event
+        std::string args;  // members of a JSON object, may be empty
+    };
+
+    Trace(): start(clock::now()) {}
+
+    void record(std::string name,
+                std::string category,
+                clock::time_point begin,
+                clock::time_point end,
+                std::string args = {}) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto tid = threads.emplace(std::this_thread::get_id(), threads.size())
+                       .first->second;
+        events.push_back({std::move(name),
+                          std::move(category),
+                          micros(begin - start),
+                          micros(end - begin),
+                          tid,
+                          std::move(args)});
+    }
+
+    [[nodiscard]] std::vector<Event> get() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events;
+    }
+
+    /**
+     * @brief Return events in the Chrome trace event format, which can be
+     *        loaded by chrome://tracing or Perfetto.
+     */
+    [[nodiscard]] std::string to_json() const {
+        std::string out = "{\"traceEvents\":[";
+        auto events = get();
+        for (size_t i = 0; i < events.size(); ++i) {
+            auto& event = events[i];
+            char times[64];
+            std::snprintf(times,
+                          sizeof(times),
+                          "\"ts\":%.3f,\"dur\":%.3f",
+                          event.ts,
+                          event.dur);
+            out += i ? ",\n" : "\n";
+            out += "{\"name\":\"" + escape(event.name) + "\",\"cat\":\"" +
+                   escape(event.category) + "\",\"ph\":\"X\"," + times +
+                   ",\"pid\":1,\"tid\":" + std::to_string(event.tid) +
+                   ",\"args\":{" + event.args + "}}";
+        }
+        out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return out;
+    }
+
+  private:
+    mutable std::mutex mutex;
+    const clock::time_point start;
+    std::vector<Event> events;
+    std::map<std::thread::id, size_t> threads;
+
+    static double micros(clock::duration duration) {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    static std::string escape(const std::string& str) {
+        std::string ret;
+        for (auto c : str) {
+            if (c == '"' || c == '\\') ret += '\\';
+            ret += c;
+        }
+        return ret;
+    }
+};
+
+/**
+ * @brief Record an event lasting for the lifetime of this object, even if it
+ *        ends with an exception. Does nothing if trace is null.
+ */
+class TraceSpan {
+  public:
+    TraceSpan(Trace* trace,
+              std::string name,
+              std::string category,
+              std::string args = {}):
+        trace(trace) {
+        if (!trace) return;
+        this->name = std::move(name);
+        this->category = std::move(category);
+        this->args = std::move(args);
+        begin = Trace::clock::now();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if (!trace) return;
+        trace->record(std::move(name),
+                      std::move(category),
+                      begin,
+                      Trace::clock::now(),
+                      std::move(args));
+    }
+
+  private:
+    Trace* trace;  // should be observer_ptr
+    std::string name;
+    std::string category;
+    std::string args;
+    Trace::clock::time_point begin;
+};
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_TRACE_HPP_
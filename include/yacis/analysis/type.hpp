@@ -74,7 +74,7 @@ class Type {
         if (tag != TypeTag::kFunction || ele[0]!=param)
             throw std::invalid_argument("Not applicable.");
         if (ele.size() == 2)
-            *this = ele.back();
+            *this = Type(ele.back());  // copy first, ele.back() is in *this
         else
             ele.erase(ele.begin());
     }
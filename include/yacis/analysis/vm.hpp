@@ -0,0 +1,315 @@
+#ifndef YACIS_ANALYSIS_VM_HPP_
+#define YACIS_ANALYSIS_VM_HPP_
+
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yacis/analysis/arena.hpp"
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/bytecode.hpp"
+#include "yacis/analysis/error.hpp"
+#include "yacis/analysis/option.hpp"
+#include "yacis/analysis/trace.hpp"
+#include "yacis/analysis/type.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::analysis {
+
+struct VmClosure;
+
+struct VmValue {
+    int32_t val = 0;
+    std::shared_ptr<const VmClosure> func;  // null if this is a scalar
+};
+
+// Runtime memory of the vm is allocated on the global heap by ArenaAllocator,
+// so that it is charged to curr_budget if any.
+using VmValues = std::vector<VmValue, ArenaAllocator<VmValue>>;
+
+struct VmClosure {
+    const Chunk* chunk;  // should be observer_ptr
+    VmValues env;        // captured values
+    VmValues args;       // applied arguments, in application order
+};
+
+inline std::shared_ptr<const VmClosure> make_closure(VmClosure closure) {
+    return std::allocate_shared<VmClosure>(ArenaAllocator<VmClosure>(),
+                                           std::move(closure));
+}
+
+class Vm {
+  public:
+    struct Frame {
+        const Chunk* chunk;        // should be observer_ptr
+        const Instr* pc;           // should be observer_ptr
+        size_t base;               // position of the first argument
+        const VmClosure* closure;  // kept alive by the slot before base
+        VmValues extra;  // arguments left by an over-application
+    };
+
+    const Program& program;
+    VmValues global_vec;
+    VmValues stack;
+    std::vector<Frame, ArenaAllocator<Frame>> frames;
+    // Calls and branches are steps, frames are the depth, and the memory of
+    // closures, the stack and frames is bytes.
+    Budget* budget = nullptr;  // should be observer_ptr
+    Trace* trace = nullptr;    // should be observer_ptr, entries recorded
+
+    explicit Vm(const Program& program,
+                Budget* budget = nullptr,
+                Trace* trace = nullptr):
+        program(program), budget(budget), trace(trace) {
+        for (size_t i = 0; i < program.builtin_num; ++i)
+            global_vec.push_back(
+                {0, make_closure({program.chunks[i].get(), {}, {}})});
+    }
+
+    /**
+     * @brief Run all entries of the program in order and return the output.
+     */
+    std::vector<std::pair<int32_t, Type>> run() {
+        std::vector<std::pair<int32_t, Type>> output;
+        for (auto&& entry : program.entries) {
+            VmValue result;
+            auto line = std::to_string(entry.pos.line);
+            TraceSpan span(trace,
+                           entry.is_output ? "<output:" + line + ">"
+                                           : entry.name,
+                           entry.is_output ? "output" : "define",
+                           "\"line\":" + line);
+            try {
+                result = run(*program.chunks[entry.chunk]);
+            } catch (const LimitExceeded& e) {
+                throw LimitError(entry.pos, e.tag);
+            }
+            if (entry.is_output)
+                output.emplace_back(result.val, entry.type);
+            else
+                global_vec.push_back(std::move(result));
+        }
+        return output;
+    }
+
+    /**
+     * @brief Run a chunk without arguments and return its result.
+     */
+    VmValue run(const Chunk& chunk) {
+        auto depth = frames.size();
+        stack.emplace_back();  // placeholder of function slot
+        frames.push_back(
+            {&chunk, chunk.code.data(), stack.size(), nullptr, {}});
+
+        auto* frame = &frames.back();
+        auto* pc = frame->pc;
+        while (true) {
+            auto instr = *pc++;
+            switch (instr.op) {
+            case OpCode::kConst:
+                stack.push_back({instr.arg, nullptr});
+                break;
+            case OpCode::kArg:
+                stack.push_back(slot(*frame, instr.arg));
+                break;
+            case OpCode::kGlobal:
+                stack.push_back(global_vec[instr.arg]);
+                break;
+            case OpCode::kClosure: {
+                const auto* chunk = program.chunks[instr.arg].get();
+                VmValues env;
+                env.reserve(chunk->captures.size());
+                for (auto i : chunk->captures) env.push_back(slot(*frame, i));
+                stack.push_back({0, make_closure({chunk, std::move(env), {}})});
+                break;
+            }
+            case OpCode::kCall:
+            case OpCode::kTailCall:
+                frame->pc = pc;
+                call(instr.arg, instr.op == OpCode::kTailCall);
+                frame = &frames.back();
+                pc = frame->pc;
+                break;
+            case OpCode::kJump:
+                pc = frame->chunk->code.data() + instr.arg;
+                break;
+            case OpCode::kJumpIfNot: {
+                if (budget) tick_budget(budget);
+                auto cond = stack.back().val;
+                stack.pop_back();
+                if (!cond) pc = frame->chunk->code.data() + instr.arg;
+                break;
+            }
+            case OpCode::kReturn: {
+                auto result = std::move(stack.back());
+                auto extra = std::move(frame->extra);
+                stack.resize(frame->base - 1);
+                frames.pop_back();
+                stack.push_back(std::move(result));
+                if (frames.size() == depth) {
+                    result = std::move(stack.back());
+                    stack.pop_back();
+                    return result;
+                }
+                if (!extra.empty()) {
+                    auto arg_num = extra.size();
+                    std::move(extra.begin(), extra.end(),
+                              std::back_inserter(stack));
+                    call(arg_num, false);
+                }
+                frame = &frames.back();
+                pc = frame->pc;
+                break;
+            }
+            case OpCode::kNegate:
+                stack.back().val = internal::WrapNegate()(stack.back().val);
+                break;
+            case OpCode::kNot:
+                stack.back().val = !stack.back().val;
+                break;
+            default:
+                binary(instr.op);
+                break;
+            }
+        }
+    }
+
+  private:
+    /**
+     * @brief Return the value in given slot of the frame. Parameters are on
+     *        the stack and captured values are in the closure.
+     */
+    const VmValue& slot(const Frame& frame, size_t index) const {
+        auto arg_num = frame.chunk->arg_num;
+        if (index < arg_num) return stack[frame.base + index];
+        return frame.closure->env[index - arg_num];
+    }
+
+    /**
+     * @brief Apply arg_num values on the top of stack to the function below
+     *        them. Push a new frame if the function is saturated, or replace
+     *        current frame if is_tail is true.
+     */
+    void call(size_t arg_num, bool is_tail) {
+        if (budget) tick_budget(budget);
+        auto func_pos = stack.size() - arg_num - 1;
+        const auto* closure = stack[func_pos].func.get();
+        auto applied = closure->args.size();
+        auto required = closure->chunk->arg_num - applied;
+
+        if (arg_num < required) {
+            auto partial = *closure;
+            std::move(stack.begin() + func_pos + 1, stack.end(),
+                      std::back_inserter(partial.args));
+            stack.resize(func_pos);
+            stack.push_back({0, make_closure(std::move(partial))});
+            return;
+        }
+
+        VmValues extra;
+        if (arg_num > required) {
+            std::move(stack.begin() + func_pos + 1 + required, stack.end(),
+                      std::back_inserter(extra));
+            stack.resize(func_pos + 1 + required);
+        }
+        if (applied)
+            stack.insert(stack.begin() + func_pos + 1,
+                         closure->args.begin(), closure->args.end());
+
+        if (is_tail && extra.empty()) {
+            auto& frame = frames.back();
+            std::move(stack.begin() + func_pos, stack.end(),
+                      stack.begin() + frame.base - 1);
+            stack.resize(frame.base + closure->chunk->arg_num);
+            frame.chunk = closure->chunk;
+            frame.pc = closure->chunk->code.data();
+            frame.closure = closure;
+        } else {
+            if (budget && budget->max_depth &&
+                frames.size() >= budget->max_depth)
+                throw LimitExceeded(LimitTag::kDepth);
+            frames.push_back({closure->chunk,
+                              closure->chunk->code.data(),
+                              func_pos + 1,
+                              closure,
+                              std::move(extra)});
+        }
+    }
+
+    void binary(OpCode op) {
+        auto val2 = stack.back().val;
+        stack.pop_back();
+        auto& val1 = stack.back().val;
+        switch (op) {
+        case OpCode::kAdd:
+            val1 = internal::WrapPlus()(val1, val2);
+            break;
+        case OpCode::kSub:
+            val1 = internal::WrapMinus()(val1, val2);
+            break;
+        case OpCode::kMul:
+            val1 = internal::WrapMultiplies()(val1, val2);
+            break;
+        case OpCode::kDiv:
+            val1 = val1 / val2;
+            break;
+        case OpCode::kMod:
+            val1 = val1 % val2;
+            break;
+        case OpCode::kEq:
+            val1 = val1 == val2;
+            break;
+        case OpCode::kNeq:
+            val1 = val1 != val2;
+            break;
+        case OpCode::kLt:
+            val1 = val1 < val2;
+            break;
+        case OpCode::kGt:
+            val1 = val1 > val2;
+            break;
+        case OpCode::kLeq:
+            val1 = val1 <= val2;
+            break;
+        case OpCode::kGeq:
+            val1 = val1 >= val2;
+            break;
+        case OpCode::kAnd:
+            val1 = val1 && val2;
+            break;
+        case OpCode::kOr:
+            val1 = val1 || val2;
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+/**
+ * @brief Analysis stage 3 (bytecode engine). Compile ast into bytecode, run
+ *        it and output results.
+ * @param root Root node of AST.
+ * @param option Evaluation options, of which only budgets and trace apply.
+ */
+inline std::vector<std::pair<int32_t, Type>>
+vm_eval(std::unique_ptr<ast::BaseNode>& root, const EvalOption& option = {}) {
+    Program program;
+    {
+        TraceSpan span(option.trace, "compile_bytecode", "compile");
+        program = compile_bytecode(root);
+    }
+    if (!option.max_steps && !option.max_bytes && !option.max_depth &&
+        !option.cancel)
+        return Vm(program, nullptr, option.trace).run();
+    Budget budget(
+        option.max_steps, option.max_bytes, option.max_depth, option.cancel);
+    BudgetScope scope(&budget);
+    return Vm(program, &budget, option.trace).run();
+}
+
+}  // namespace yacis::analysis
+
+#endif  // YACIS_ANALYSIS_VM_HPP_
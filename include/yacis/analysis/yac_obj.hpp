@@ -1,83 +1,179 @@
 #ifndef YACIS_ASM_GEN_YAC_OBJ_HPP_
 #define YACIS_ASM_GEN_YAC_OBJ_HPP_
 
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "yacis/analysis/arena.hpp"
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/memo.hpp"
+#include "yacis/analysis/profile.hpp"
+#include "yacis/analysis/stats.hpp"
+#include "yacis/analysis/trace.hpp"
+
 namespace yacis::analysis {
 
-template<typename T>
-class List: public std::enable_shared_from_this<List<T>> {
+class YacObj;
+
+using ObjRc = std::shared_ptr<const YacObj>;
+
+/**
+ * @brief Runtime value. Int, Bool and Char are stored inline in val, only
+ *        functions live on the heap.
+ */
+struct Value {
+    int32_t val = 0;
+    ObjRc obj;  // null if this is a scalar
+};
+
+/**
+ * @brief Flat environment of a function call. It holds the parameters followed
+ *        by the values captured from enclosing lambdas.
+ */
+using Frame = std::vector<Value, ArenaAllocator<Value>>;
+using Context = std::shared_ptr<const Frame>;
+
+inline const Context empty_context =
+    std::make_shared<const Frame>(ArenaAllocator<Value>(nullptr));
+
+/**
+ * @brief Kinds of objects that eval dispatches with a switch, so that their
+ *        step can be inlined. Any other object is kOther and its step is called
+ *        virtually. Subclasses overriding step must be kOther.
+ */
+enum class ObjKind {
+    kOther,
+    kVal,
+    kArg,
+    kGlobal,
+    kConst,
+    kFunc,
+    kAppl,
+    kKnownCall,
+    kCond
+};
+
+class YacObj {
   public:
-    const bool is_nil;
-    const T val;
-    const std::shared_ptr<const List<T>> tail;
+    const ObjKind kind;
 
-    List(): is_nil(true), val(), tail() {}
-    explicit List(T val, std::shared_ptr<const List<T>> tail = nullptr):
-        is_nil(false), val(std::move(val)), tail(std::move(tail)) {}
+    explicit YacObj(ObjKind kind = ObjKind::kOther): kind(kind) {}
+
+    virtual ~YacObj() = default;
 
     /**
-     * @brief Return a shared_ptr of this object.
+     * @brief Evaluate this object in given context. Calls in tail position
+     *        are trampolined here, so tail recursions run in constant stack.
      */
-    std::shared_ptr<const List<T>> get_ptr() const {
-        return this->shared_from_this();
-    }
+    Value eval(const Context& context) const;
 
     /**
-     * @brief Index operator, starting from 0. If the index is greater than
-     *        list length, return Nil node.
+     * @brief Evaluate this object until a call in tail position is reached.
+     *        In that case, set tail to the object to be evaluated next, replace
+     *        context with its context and return an empty value. Otherwise
+     *        return the result and leave tail unchanged.
      */
-    std::shared_ptr<const List<T>> index(size_t i) const {
-        if (i && !is_nil)
-            return tail->index(i - 1);
-        else
-            return get_ptr();
-    }
+    virtual Value step(Context& context, const YacObj*& tail) const = 0;
 
     /**
-     * @brief Enqueue an element.
+     * @brief Return a value standing for self, whose pointee is this object,
+     *        evaluated in given context, without evaluating it. Used for
+     *        arguments in lazy mode.
      */
-    std::shared_ptr<const List<T>> cons(T ele) const {
-        return std::make_shared<const List<T>>(std::move(ele), get_ptr());
-    }
-};
-
-class YacObj;
+    virtual Value delayed(const ObjRc& self, const Context& context) const;
 
-using ObjRc = std::shared_ptr<const YacObj>;
-using Context = std::shared_ptr<const List<const ObjRc>>;
+    /**
+     * @brief Return the value of self, whose obj is this object. Only thunks
+     *        are not values of themselves.
+     */
+    virtual Value forced(const Value& self) const {
+        return self;
+    }
 
-inline Context empty_context = std::make_shared<const List<const ObjRc>>();
+  private:
+    /**
+     * @brief Trampoline of eval. If monitored, it charges curr_budget,
+     *        delimits profile frames of curr_recorder and counts depth in
+     *        curr_stats, which are otherwise left out of the loop.
+     */
+    template<bool monitored>
+    Value run(const Context& context) const;
+};
 
-class YacObj: public std::enable_shared_from_this<YacObj> {
+/**
+ * @brief Return the value of value, forcing it if it is a thunk.
+ */
+inline Value force(const Value& value) {
+    return value.obj ? value.obj->forced(value) : value;
+}
+
+/**
+ * @brief Return the value of obj in context without evaluating it.
+ */
+inline Value delay(const ObjRc& obj, const Context& context) {
+    return obj->delayed(obj, context);
+}
+
+/**
+ * @brief Delayed evaluation of an argument in lazy mode. It is evaluated at
+ *        most once, then it holds the result only. Thunks of global variables
+ *        may be forced during an output, so they do not allocate in its arena.
+ */
+class YacThunk: public YacObj {
   public:
-    virtual ~YacObj() = default;
+    YacThunk(ObjRc expr, Context context, bool is_global = false):
+        is_global(is_global),
+        expr(std::move(expr)),
+        context(std::move(context)) {}
 
     /**
-     * @brief Return a shared_ptr of this object.
+     * @brief Thunks are values, evaluating one forces it.
      */
-    ObjRc get_ptr() const {
-        return this->shared_from_this();
+    Value step(Context&, const YacObj*&) const override {
+        return forced({});
     }
 
-    virtual ObjRc eval(const Context&) const {
-        return get_ptr();
+    Value forced(const Value&) const override {
+        if (expr) {
+            if (is_global) {
+                ArenaScope scope(nullptr);
+                result = expr->eval(context);
+            } else {
+                result = expr->eval(context);
+            }
+            expr.reset();
+            context.reset();
+        }
+        return result;
     }
+
+  private:
+    const bool is_global;
+    mutable ObjRc expr;  // null once forced
+    mutable Context context;
+    mutable Value result;
 };
 
+inline Value YacObj::delayed(const ObjRc& self, const Context& context) const {
+    count_alloc(AllocKind::kThunk);
+    return {0, make_obj<YacThunk>(self, context)};
+}
+
 class YacVal: public YacObj {
   public:
     int32_t val;
 
-    explicit YacVal(int32_t val): val(val) {}
+    explicit YacVal(int32_t val): YacObj(ObjKind::kVal), val(val) {}
 
-    ObjRc eval(const Context&) const override {
-        return get_ptr();
+    Value step(Context&, const YacObj*&) const override {
+        return {val, nullptr};
     }
 
-    static const YacVal& from(const ObjRc& rc) {
-        return *static_cast<const YacVal*>(&*rc);
+    Value delayed(const ObjRc&, const Context&) const override {
+        return {val, nullptr};
     }
 };
 
@@ -85,67 +181,266 @@ class YacArg: public YacObj {
   public:
     size_t index;
 
-    explicit YacArg(size_t index): index(index) {}
+    explicit YacArg(size_t index, ObjKind kind = ObjKind::kArg):
+        YacObj(kind), index(index) {}
 
-    ObjRc eval(const Context& context) const override {
-        return context->index(index)->val;
+    Value step(Context& context, const YacObj*&) const override {
+        return (*context)[index];
+    }
+};
+
+/**
+ * @brief Argument in lazy mode, forced when evaluated but passed on as is.
+ */
+class YacLazyArg: public YacArg {
+  public:
+    explicit YacLazyArg(size_t index): YacArg(index, ObjKind::kOther) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        return force((*context)[index]);
+    }
+
+    Value delayed(const ObjRc&, const Context& context) const override {
+        return (*context)[index];
     }
 };
 
 class YacGlobal: public YacObj {
   public:
-    std::vector<ObjRc>* global_vec;  // should be observer_ptr
+    std::vector<Value>* global_vec;  // should be observer_ptr
     size_t index;
 
-    YacGlobal(std::vector<ObjRc>* global_vec, size_t index):
-        global_vec(global_vec), index(index) {}
+    YacGlobal(std::vector<Value>* global_vec,
+              size_t index,
+              ObjKind kind = ObjKind::kGlobal):
+        YacObj(kind), global_vec(global_vec), index(index) {}
 
-    ObjRc eval(const Context&) const override {
+    Value step(Context&, const YacObj*&) const override {
         return (*global_vec)[index];  // lazy cuz recursions exist
     }
 };
 
+/**
+ * @brief Global variable that may hold a thunk, forced when evaluated. In lazy
+ *        mode it is passed on as is.
+ */
+class YacLazyGlobal: public YacGlobal {
+  public:
+    YacLazyGlobal(std::vector<Value>* global_vec, size_t index):
+        YacGlobal(global_vec, index, ObjKind::kOther) {}
+
+    Value step(Context&, const YacObj*&) const override {
+        return force((*global_vec)[index]);
+    }
+
+    Value delayed(const ObjRc&, const Context&) const override {
+        return (*global_vec)[index];
+    }
+};
+
+/**
+ * @brief Function value. It is a value rather than code, so it is only
+ *        evaluated once all arguments are applied, which calls it. Code
+ *        evaluating to a function holds it in a YacConst.
+ */
 class YacFunc: public YacObj {
   public:
-    const Context context;
-    const size_t arg_num;
+    const Context context;  // applied arguments and captured values
+    const size_t param_num;
+    const size_t arg_num;  // number of arguments still missing
     const ObjRc body;
 
     YacFunc(size_t arg_num, ObjRc body):
-        context(empty_context), arg_num(arg_num), body(std::move(body)) {}
-
-    YacFunc(Context context, size_t arg_num, ObjRc body):
-        context(std::move(context)), arg_num(arg_num), body(std::move(body)) {}
-
-    ObjRc apply(const ObjRc& arg) const {
-        return std::make_shared<const YacFunc>(
-            context->cons(arg), arg_num - 1, body);
+        YacObj(ObjKind::kFunc),
+        context(std::make_shared<const Frame>(
+            arg_num, Value(), ArenaAllocator<Value>(nullptr))),
+        param_num(arg_num),
+        arg_num(arg_num),
+        body(std::move(body)) {}
+
+    YacFunc(Context context, size_t param_num, size_t arg_num, ObjRc body):
+        YacObj(ObjKind::kFunc),
+        context(std::move(context)),
+        param_num(param_num),
+        arg_num(arg_num),
+        body(std::move(body)) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        context = this->context;
+        tail = body.get();
+        return {};
     }
 
-    ObjRc eval(const Context&) const override {
-        if (arg_num)
-            return get_ptr();
-        else
-            return body->eval(context);
+    static const YacFunc& from(const Value& value) {
+        return *static_cast<const YacFunc*>(&*value.obj);
     }
+};
+
+/**
+ * @brief Code evaluating to a known value, such as a lambda capturing nothing.
+ */
+class YacConst: public YacObj {
+  public:
+    const Value value;
 
-    static const YacFunc& from(const ObjRc& rc) {
-        return *static_cast<const YacFunc*>(&*rc);
+    explicit YacConst(Value value):
+        YacObj(ObjKind::kConst), value(std::move(value)) {}
+
+    Value step(Context&, const YacObj*&) const override {
+        return value;
     }
 };
 
+/**
+ * @brief Make code evaluating to a function of arg_num parameters with body.
+ */
+inline ObjRc make_func(size_t arg_num, ObjRc body) {
+    return std::make_shared<YacConst>(
+        Value{0, std::make_shared<YacFunc>(arg_num, std::move(body))});
+}
+
 class YacAppl: public YacObj {
   public:
     const std::vector<ObjRc> ele;
 
-    explicit YacAppl(std::vector<ObjRc> ele): ele(std::move(ele)) {}
+    explicit YacAppl(std::vector<ObjRc> ele, ObjKind kind = ObjKind::kAppl):
+        YacObj(kind), ele(std::move(ele)) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        return apply(context, tail, [&](size_t i) {
+            return ele[i]->eval(context);
+        });
+    }
 
-    ObjRc eval(const Context& context) const override {
-        auto it = ele.begin();
-        auto func = (*it)->eval(context);
-        for (++it; it != ele.end(); ++it)
-            func = YacFunc::from(func).apply((*it)->eval(context));
-        return YacFunc::from(func).eval(context);
+  protected:
+    /**
+     * @brief Fill arguments into a copy of the frame of the function, one copy
+     *        for each function reached. A saturated call in the end becomes a
+     *        tail call. The value of argument ele[i] is given by arg(i).
+     */
+    template<typename Arg>
+    Value apply(Context& context, const YacObj*& tail, Arg&& arg) const {
+        auto func = ele[0]->eval(context);
+        for (size_t i = 1; i < ele.size();) {
+            const auto& f = YacFunc::from(func);
+            if (!f.arg_num) {  // over-applied, call it before going on
+                func = f.eval(context);
+                continue;
+            }
+            auto frame = make_obj<Frame>(*f.context, curr_allocator<Value>());
+            count_frame(frame->size());
+            auto num = std::min(f.arg_num, ele.size() - i);
+            auto slot = f.param_num - f.arg_num;
+            for (size_t j = 0; j < num; ++j) (*frame)[slot + j] = arg(i + j);
+            i += num;
+            if (num == f.arg_num && i == ele.size()) {
+                context = std::move(frame);
+                tail = f.body.get();  // bodies are owned by the object graph
+                return {};
+            }
+            count_alloc(AllocKind::kPartial);
+            func = {0,
+                    make_obj<YacFunc>(std::move(frame),
+                                      f.param_num,
+                                      f.arg_num - num,
+                                      f.body)};
+        }
+        return func;
+    }
+};
+
+/**
+ * @brief Application in lazy mode, whose arguments are passed as thunks.
+ */
+class YacLazyAppl: public YacAppl {
+  public:
+    explicit YacLazyAppl(std::vector<ObjRc> ele):
+        YacAppl(std::move(ele), ObjKind::kOther) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        return apply(context, tail, [&](size_t i) {
+            return delay(ele[i], context);
+        });
+    }
+};
+
+/**
+ * @brief Closed computation, whose value is the same wherever it occurs. It is
+ *        evaluated when first needed, at most once, and shared by all its
+ *        occurrences. The thunk must not be forced by several threads.
+ */
+class YacShared: public YacObj {
+  public:
+    const Value thunk;
+
+    explicit YacShared(ObjRc expr):
+        thunk{0,
+              std::make_shared<YacThunk>(
+                  std::move(expr), empty_context, true)} {}
+
+    Value step(Context&, const YacObj*&) const override {
+        return force(thunk);
+    }
+
+    Value delayed(const ObjRc&, const Context&) const override {
+        return thunk;
+    }
+};
+
+/**
+ * @brief Saturated call to a global function defined by a lambda, whose arity
+ *        is known ahead. The frame is filled with all arguments at once, with
+ *        no copy of the function value nor of its empty frame.
+ */
+class YacKnownCall: public YacObj {
+  public:
+    std::vector<Value>* global_vec;  // should be observer_ptr
+    const size_t index;
+    const std::vector<ObjRc> args;
+
+    YacKnownCall(std::vector<Value>* global_vec,
+                 size_t index,
+                 std::vector<ObjRc> args):
+        YacObj(ObjKind::kKnownCall),
+        global_vec(global_vec),
+        index(index),
+        args(std::move(args)) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        auto frame =
+            make_obj<Frame>(args.size(), Value(), curr_allocator<Value>());
+        count_frame(args.size());
+        for (size_t i = 0; i < args.size(); ++i)
+            (*frame)[i] = args[i]->eval(context);
+        context = std::move(frame);
+        tail = YacFunc::from((*global_vec)[index]).body.get();
+        return {};
+    }
+};
+
+class YacLambda: public YacObj {
+  public:
+    const size_t arg_num;
+    const std::vector<size_t> captures;
+    const ObjRc body;
+
+    YacLambda(size_t arg_num, std::vector<size_t> captures, ObjRc body):
+        arg_num(arg_num),
+        captures(std::move(captures)),
+        body(std::move(body)) {}
+
+    /**
+     * @brief Create a closure with captured values copied from context.
+     */
+    Value step(Context& context, const YacObj*&) const override {
+        auto frame = make_obj<Frame>(
+            arg_num + captures.size(), Value(), curr_allocator<Value>());
+        count_frame(frame->size());
+        count_alloc(AllocKind::kClosure);
+        for (size_t i = 0; i < captures.size(); ++i)
+            (*frame)[arg_num + i] = (*context)[captures[i]];
+        return {0,
+                make_obj<YacFunc>(std::move(frame), arg_num, arg_num, body)};
     }
 };
 
@@ -156,19 +451,162 @@ class YacCond: public YacObj {
     const ObjRc else_obj;
 
     YacCond(ObjRc if_obj, ObjRc then_obj, ObjRc else_obj):
+        YacObj(ObjKind::kCond),
         if_obj(std::move(if_obj)),
         then_obj(std::move(then_obj)),
         else_obj(std::move(else_obj)) {}
 
-    ObjRc eval(const Context& context) const override {
-        auto result = YacVal::from(if_obj->eval(context)).val;
+    Value step(Context& context, const YacObj*& tail) const override {
+        auto result = if_obj->eval(context).val;
         if (result)
-            return then_obj->eval(context);
+            tail = then_obj.get();
         else
-            return else_obj->eval(context);
+            tail = else_obj.get();
+        return {};
     }
 };
 
+/**
+ * @brief Body wrapper of a memoized global function. Results are cached by
+ *        argument values, so all parameters and the result must be scalars.
+ */
+class YacMemo: public YacObj {
+  public:
+    MemoTable* memo_table;  // should be observer_ptr
+    const int32_t id;
+    const size_t arg_num;
+    const ObjRc body;
+
+    YacMemo(MemoTable* memo_table, int32_t id, size_t arg_num, ObjRc body):
+        memo_table(memo_table),
+        id(id),
+        arg_num(arg_num),
+        body(std::move(body)) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        thread_local MemoTable::Key key;
+        make_key(key, *context);
+        if (auto result = memo_table->find(key)) return {*result, nullptr};
+        auto result = body->eval(context);
+        make_key(key, *context);  // overwritten by recursive calls
+        memo_table->insert(key, result.val);
+        return result;
+    }
+
+  private:
+    void make_key(MemoTable::Key& key, const Frame& frame) const {
+        key.clear();
+        key.push_back(id);
+        for (size_t i = 0; i < arg_num; ++i) key.push_back(frame[i].val);
+    }
+};
+
+/**
+ * @brief Body wrapper of a global function, or code of a global variable or
+ *        an output, in profiling mode. Entering it enters a profile frame. A
+ *        tail call from a function body replaces its frame, while statements
+ *        evaluate their code as a nested call, so they stay at the root of
+ *        what they call.
+ */
+class YacProfiled: public YacObj {
+  public:
+    const size_t id;
+    const bool is_statement;
+    const ObjRc body;
+
+    YacProfiled(size_t id, bool is_statement, ObjRc body):
+        id(id), is_statement(is_statement), body(std::move(body)) {}
+
+    Value step(Context& context, const YacObj*& tail) const override {
+        if (curr_recorder) curr_recorder->enter(id);
+        if (is_statement) return body->eval(context);
+        tail = body.get();
+        return {};
+    }
+};
+
+/**
+ * @brief Code of a global variable evaluated when first used, in tracing
+ *        mode. Evaluating it is recorded as an event of trace.
+ */
+class YacTraced: public YacObj {
+  public:
+    Trace* const trace;  // should be observer_ptr
+    const std::string name;
+    const size_t line;
+    const ObjRc body;
+
+    YacTraced(Trace* trace, std::string name, size_t line, ObjRc body):
+        trace(trace),
+        name(std::move(name)),
+        line(line),
+        body(std::move(body)) {}
+
+    Value step(Context& context, const YacObj*&) const override {
+        TraceSpan span(
+            trace, name, "define", "\"line\":" + std::to_string(line));
+        return body->eval(context);
+    }
+};
+
+inline Value YacObj::eval(const Context& context) const {
+    // Leaves are the most common objects. They never reach a tail call, so
+    // context is not copied for them.
+    switch (kind) {
+    case ObjKind::kVal:
+        return {static_cast<const YacVal*>(this)->val, nullptr};
+    case ObjKind::kArg:
+        return (*context)[static_cast<const YacArg*>(this)->index];
+    case ObjKind::kGlobal: {
+        const auto* global = static_cast<const YacGlobal*>(this);
+        return (*global->global_vec)[global->index];
+    }
+    case ObjKind::kConst:
+        return static_cast<const YacConst*>(this)->value;
+    default:
+        break;
+    }
+    if (curr_budget || curr_recorder || curr_stats) return run<true>(context);
+    return run<false>(context);
+}
+
+template<bool monitored>
+Value YacObj::run(const Context& context) const {
+    auto* budget = monitored ? curr_budget : nullptr;
+    DepthGuard guard(budget);
+    ProfileGuard profile_guard(monitored ? curr_recorder : nullptr);
+    StatsGuard stats_guard(monitored ? curr_stats : nullptr);
+    auto curr = context;
+    const YacObj* obj = this;
+    while (true) {
+        if (budget) tick_budget(budget);
+        const YacObj* tail = nullptr;
+        Value result;
+        switch (obj->kind) {
+        case ObjKind::kFunc:
+            result =
+                static_cast<const YacFunc*>(obj)->YacFunc::step(curr, tail);
+            break;
+        case ObjKind::kAppl:
+            result =
+                static_cast<const YacAppl*>(obj)->YacAppl::step(curr, tail);
+            break;
+        case ObjKind::kKnownCall:
+            result = static_cast<const YacKnownCall*>(obj)->YacKnownCall::step(
+                curr, tail);
+            break;
+        case ObjKind::kCond:
+            result =
+                static_cast<const YacCond*>(obj)->YacCond::step(curr, tail);
+            break;
+        default:
+            result = obj->step(curr, tail);
+        }
+        if (!tail) return result;
+        obj = tail;
+    }
+}
+
 }  // namespace yacis::analysis
 
 #endif  // YACIS_ASM_GEN_YAC_OBJ_HPP_
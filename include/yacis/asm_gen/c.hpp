@@ -0,0 +1,376 @@
+#ifndef YACIS_ASM_GEN_C_HPP_
+#define YACIS_ASM_GEN_C_HPP_
+
+#include <any>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "yacis/analysis/replace.hpp"
+#include "yacis/analysis/type.hpp"
+#include "yacis/ast/node.hpp"
+
+namespace yacis::asm_gen {
+
+namespace internal {
+
+/**
+ * @brief Runtime support of generated C code.
+ *
+ * Every value is a yac_val. Int, Bool and Char are stored as int32_t, and a
+ * function is a pointer to a yac_closure, whose frame holds its parameters
+ * followed by its captures. The code of a lambda takes a frame it may
+ * overwrite.
+ *
+ * yac_apply applies arguments one closure at a time. Partial applications
+ * copy the closure to the heap with more arguments filled, saturated calls
+ * copy its frame to the stack and call the code.
+ */
+inline const std::string c_runtime = R"(#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef intptr_t yac_val;
+
+typedef struct yac_closure {
+    yac_val (*code)(yac_val* frame);
+    int32_t param_num;
+    int32_t applied;
+    int32_t capture_num;
+    yac_val frame[];
+} yac_closure;
+
+static yac_closure* yac_alloc(int32_t size) {
+    yac_closure* ret = malloc(sizeof(yac_closure) + size * sizeof(yac_val));
+    if (!ret) {
+        fputs("Out of memory.\n", stderr);
+        exit(1);
+    }
+    return ret;
+}
+
+static yac_val yac_closure_new(yac_val (*code)(yac_val*),
+                               int32_t param_num,
+                               int32_t capture_num,
+                               const yac_val* captures) {
+    yac_closure* ret = yac_alloc(param_num + capture_num);
+    ret->code = code;
+    ret->param_num = param_num;
+    ret->applied = 0;
+    ret->capture_num = capture_num;
+    if (capture_num)
+        memcpy(ret->frame + param_num,
+               captures,
+               capture_num * sizeof(yac_val));
+    return (yac_val)ret;
+}
+
+static inline yac_val yac_apply(yac_val func,
+                                int32_t arg_num,
+                                const yac_val* args) {
+    while (arg_num) {
+        yac_closure* f = (yac_closure*)func;
+        int32_t missing = f->param_num - f->applied;
+        int32_t size = f->param_num + f->capture_num;
+        if (arg_num < missing) {
+            yac_closure* g = yac_alloc(size);
+            memcpy(g, f, sizeof(yac_closure) + size * sizeof(yac_val));
+            memcpy(g->frame + f->applied, args, arg_num * sizeof(yac_val));
+            g->applied += arg_num;
+            return (yac_val)g;
+        }
+        {
+            yac_val frame[size];
+            memcpy(frame, f->frame, size * sizeof(yac_val));
+            memcpy(frame + f->applied, args, missing * sizeof(yac_val));
+            func = f->code(frame);
+        }
+        args += missing;
+        arg_num -= missing;
+    }
+    return func;
+}
+
+#define YAC_WRAP(expr) ((yac_val)(int32_t)(uint32_t)(expr))
+
+static yac_val yac_negate(yac_val a) { return YAC_WRAP(-(uint32_t)a); }
+static yac_val yac_add(yac_val a, yac_val b) {
+    return YAC_WRAP((uint32_t)a + (uint32_t)b);
+}
+static yac_val yac_sub(yac_val a, yac_val b) {
+    return YAC_WRAP((uint32_t)a - (uint32_t)b);
+}
+static yac_val yac_mul(yac_val a, yac_val b) {
+    return YAC_WRAP((uint32_t)a * (uint32_t)b);
+}
+static yac_val yac_div(yac_val a, yac_val b) {
+    return (int32_t)a / (int32_t)b;
+}
+static yac_val yac_mod(yac_val a, yac_val b) {
+    return (int32_t)a % (int32_t)b;
+}
+static yac_val yac_eq(yac_val a, yac_val b) { return a == b; }
+static yac_val yac_neq(yac_val a, yac_val b) { return a != b; }
+static yac_val yac_lt(yac_val a, yac_val b) { return a < b; }
+static yac_val yac_gt(yac_val a, yac_val b) { return a > b; }
+static yac_val yac_leq(yac_val a, yac_val b) { return a <= b; }
+static yac_val yac_geq(yac_val a, yac_val b) { return a >= b; }
+static yac_val yac_and(yac_val a, yac_val b) { return a && b; }
+static yac_val yac_or(yac_val a, yac_val b) { return a || b; }
+static yac_val yac_not(yac_val a) { return !a; }
+
+static yac_val yac_builtin_negate(yac_val* f) { return yac_negate(f[0]); }
+static yac_val yac_builtin_add(yac_val* f) { return yac_add(f[0], f[1]); }
+static yac_val yac_builtin_sub(yac_val* f) { return yac_sub(f[0], f[1]); }
+static yac_val yac_builtin_mul(yac_val* f) { return yac_mul(f[0], f[1]); }
+static yac_val yac_builtin_div(yac_val* f) { return yac_div(f[0], f[1]); }
+static yac_val yac_builtin_mod(yac_val* f) { return yac_mod(f[0], f[1]); }
+static yac_val yac_builtin_eq(yac_val* f) { return yac_eq(f[0], f[1]); }
+static yac_val yac_builtin_neq(yac_val* f) { return yac_neq(f[0], f[1]); }
+static yac_val yac_builtin_lt(yac_val* f) { return yac_lt(f[0], f[1]); }
+static yac_val yac_builtin_gt(yac_val* f) { return yac_gt(f[0], f[1]); }
+static yac_val yac_builtin_leq(yac_val* f) { return yac_leq(f[0], f[1]); }
+static yac_val yac_builtin_geq(yac_val* f) { return yac_geq(f[0], f[1]); }
+static yac_val yac_builtin_and(yac_val* f) { return yac_and(f[0], f[1]); }
+static yac_val yac_builtin_or(yac_val* f) { return yac_or(f[0], f[1]); }
+static yac_val yac_builtin_not(yac_val* f) { return yac_not(f[0]); }
+
+static void yac_print(yac_val val, int type) {
+    if (type == 0)
+        printf("%d", (int)val);
+    else if (type == 1)
+        putchar((char)val);
+    else
+        fputs(val ? "True" : "False", stdout);
+}
+)";
+
+class CVisitor: public ast::BaseVisitor {
+  public:
+    std::vector<std::string> functions;
+    std::string main_body;
+    size_t global_count = analysis::internal::init_global_table.size();
+
+    // Lambdas bound to global variables, global index -> (function, arity).
+    std::map<size_t, std::pair<std::string, size_t>> direct;
+
+    // Global index of the function whose top lambda is being compiled, whose
+    // saturated calls in tail position become loops.
+    size_t self = 0;
+    bool in_self = false;
+
+    std::any call(std::unique_ptr<ast::BaseNode>& p) {
+        return p->accept(this);
+    }
+
+    std::string expr(std::unique_ptr<ast::BaseNode>& p) {
+        return std::any_cast<std::string>(call(p));
+    }
+
+    static std::string literal(int32_t val) {
+        if (val == std::numeric_limits<int32_t>::min())
+            return "(-2147483647 - 1)";
+        return std::to_string(val);
+    }
+
+    /**
+     * @brief Return a compound literal array of expressions of nodes from
+     *        begin to end.
+     */
+    std::string array(std::vector<std::unique_ptr<ast::BaseNode>>& nodes,
+                      size_t begin,
+                      size_t end) {
+        std::string ret = "(yac_val[]){";
+        for (auto i = begin; i < end; ++i)
+            ret += (i == begin ? "" : ", ") + expr(nodes[i]);
+        return ret + "}";
+    }
+
+    /**
+     * @brief Return statements returning the value of p, where p is in tail
+     *        position.
+     */
+    std::string tail(std::unique_ptr<ast::BaseNode>& p,
+                     const std::string& indent) {
+        if (p->tag == ast::NodeTag::kCondExpr) {
+            auto& n = *p;
+            return indent + "if (" + expr(n.children[0]) + ") {\n" +
+                   tail(n.children[1], indent + "    ") + indent +
+                   "} else {\n" + tail(n.children[2], indent + "    ") +
+                   indent + "}\n";
+        }
+        if (in_self && p->tag == ast::NodeTag::kApplExpr) {
+            auto& n = *p;
+            auto& head = n.children[0];
+            if (head->tag == ast::NodeTag::kGlobal &&
+                ast::as<ast::GlobalNode>(head).index == self &&
+                n.children.size() - 1 == direct[self].second) {
+                std::string ret = indent + "{\n";
+                for (size_t i = 1; i < n.children.size(); ++i)
+                    ret += indent + "    yac_val a" + std::to_string(i - 1) +
+                           " = " + expr(n.children[i]) + ";\n";
+                for (size_t i = 1; i < n.children.size(); ++i)
+                    ret += indent + "    frame[" + std::to_string(i - 1) +
+                           "] = a" + std::to_string(i - 1) + ";\n";
+                return ret + indent + "    continue;\n" + indent + "}\n";
+            }
+        }
+        return indent + "return " + expr(p) + ";\n";
+    }
+
+    /**
+     * @brief Emit a C function of n and return its name.
+     */
+    std::string lambda(ast::LambdaExprNode& n) {
+        auto name = "yac_lambda_" + std::to_string(functions.size());
+        functions.emplace_back();
+        auto index = functions.size() - 1;
+        auto body = "static yac_val " + name + "(yac_val* frame) {\n";
+        body += "    (void)frame;\n";
+        body += "    for (;;) {\n";
+        body += tail(n.children.back(), "        ");
+        body += "    }\n}\n";
+        functions[index] = std::move(body);
+        return name;
+    }
+
+    std::any visit(ast::BaseNode& n) override {
+        for (auto&& i : n.children) call(i);
+        return std::any();
+    }
+
+    std::any visit(ast::ValNode& n) override {
+        return literal(n.value);
+    }
+
+    std::any visit(ast::ArgNode& n) override {
+        return "frame[" + std::to_string(n.index) + "]";
+    }
+
+    std::any visit(ast::GlobalNode& n) override {
+        return "yac_globals[" + std::to_string(n.index) + "]";
+    }
+
+    std::any visit(ast::ApplExprNode& n) override {
+        auto& head = n.children[0];
+        auto arg_num = n.children.size() - 1;
+        if (head->tag == ast::NodeTag::kGlobal) {
+            auto index = ast::as<ast::GlobalNode>(head).index;
+            if (const auto* builtin =
+                    analysis::internal::saturated_builtin(index, arg_num)) {
+                std::string ret = "yac_" + builtin->name + "(";
+                for (size_t i = 1; i < n.children.size(); ++i)
+                    ret += (i == 1 ? "" : ", ") + expr(n.children[i]);
+                return ret + ")";
+            }
+            auto it = direct.find(index);
+            if (it != direct.end() && it->second.second == arg_num)
+                return it->second.first + "(" +
+                       array(n.children, 1, n.children.size()) + ")";
+        }
+        return "yac_apply(" + expr(head) + ", " + std::to_string(arg_num) +
+               ", " + array(n.children, 1, n.children.size()) + ")";
+    }
+
+    std::any visit(ast::CondExprNode& n) override {
+        return "(" + expr(n.children[0]) + " ? " + expr(n.children[1]) +
+               " : " + expr(n.children[2]) + ")";
+    }
+
+    std::any visit(ast::LambdaExprNode& n) override {
+        auto temp = in_self;
+        in_self = false;
+        auto name = lambda(n);
+        in_self = temp;
+
+        auto& captures = n.info.captures;
+        std::string values = "NULL";
+        if (!captures.empty()) {
+            values = "(yac_val[]){";
+            for (size_t i = 0; i < captures.size(); ++i)
+                values += (i ? ", frame[" : "frame[") +
+                          std::to_string(captures[i]) + "]";
+            values += "}";
+        }
+        return "yac_closure_new(" + name + ", " +
+               std::to_string(n.children.size() - 1) + ", " +
+               std::to_string(captures.size()) + ", " + values + ")";
+    }
+
+    std::any visit(ast::ValueAssignNode& n) override {
+        auto index = global_count++;
+        std::string value;
+        if (n.children[1]->tag == ast::NodeTag::kLambdaExpr) {
+            auto& node = ast::as<ast::LambdaExprNode>(n.children[1]);
+            auto param_num = node.children.size() - 1;
+            direct[index] = {"yac_lambda_" + std::to_string(functions.size()),
+                             param_num};
+            self = index;
+            in_self = true;
+            auto name = lambda(node);
+            in_self = false;
+            value = "yac_closure_new(" + name + ", " +
+                    std::to_string(param_num) + ", 0, NULL)";
+        } else {
+            value = expr(n.children[1]);
+        }
+        main_body += "    yac_globals[" + std::to_string(index) +
+                     "] = " + value + ";\n";
+        return std::any();
+    }
+
+    std::any visit(ast::OutputNode& n) override {
+        auto& type = n.info.type;
+        auto tag = 2;
+        if (type == analysis::t_int)
+            tag = 0;
+        else if (type == analysis::t_char)
+            tag = 1;
+        main_body += "    yac_print(" + expr(n.children[0]) + ", " +
+                     std::to_string(tag) + ");\n";
+        return std::any();
+    }
+
+    std::string generate() {
+        std::string ret = c_runtime + "\n";
+        for (size_t i = 0; i < functions.size(); ++i)
+            ret += "static yac_val yac_lambda_" + std::to_string(i) +
+                   "(yac_val* frame);\n";
+        ret += "\nstatic yac_val yac_globals[" +
+               std::to_string(global_count) + "];\n";
+        for (auto&& i : functions) ret += "\n" + i;
+        ret += "\nint main(void) {\n";
+        const auto& builtins = analysis::internal::builtins;
+        for (size_t i = 0; i < builtins.size(); ++i)
+            ret += "    yac_globals[" + std::to_string(i) +
+                   "] = yac_closure_new(yac_builtin_" + builtins[i].name +
+                   ", " + std::to_string(builtins[i].arg_num) +
+                   ", 0, NULL);\n";
+        ret += main_body;
+        ret += "    return 0;\n}\n";
+        return ret;
+    }
+};
+
+}  // namespace internal
+
+/**
+ * @brief Translate replaced ast into a C99 program, which prints outputs like
+ *        the generated MIPS code. Saturated calls of builtins and of global
+ *        functions are direct, and such calls of a global function to itself
+ *        in tail position become loops.
+ * @param root Root node of AST.
+ */
+inline std::string generate_c(std::unique_ptr<ast::BaseNode>& root) {
+    internal::CVisitor visitor;
+    visitor.call(root);
+    return visitor.generate();
+}
+
+}  // namespace yacis::asm_gen
+
+#endif  // YACIS_ASM_GEN_C_HPP_
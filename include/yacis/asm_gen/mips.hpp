@@ -0,0 +1,389 @@
+#ifndef YACIS_ASM_GEN_MIPS_HPP_
+#define YACIS_ASM_GEN_MIPS_HPP_
+
+#include <set>
+#include <string>
+#include <utility>
+
+#include "yacis/analysis/bytecode.hpp"
+#include "yacis/analysis/type.hpp"
+
+namespace yacis::asm_gen {
+
+namespace internal {
+
+using analysis::Instr;
+using analysis::OpCode;
+using analysis::Program;
+
+/**
+ * @brief Runtime support of generated code.
+ *
+ * A function value is a pointer to a closure record of 4 header words, which
+ * are code address, number of parameters, number of applied arguments and
+ * number of captures, followed by a frame of parameters and captures. Int,
+ * Bool and Char values are raw words.
+ *
+ * yac_apply applies the function below $a1 arguments on top of stack, and
+ * returns the result in $v0. Arguments and the function are left for the
+ * caller to pop. Partial applications copy the record to the heap with more
+ * arguments filled. Saturated calls copy it to the stack instead, then the
+ * code is called with $s0 pointing to the copy, and over-applications go on
+ * with the result. The header word of applied arguments in the copy is reused
+ * to store its size.
+ *
+ * Code of chunks saves $ra on entry and keeps temporaries on the stack. Only
+ * yac_apply changes $s0 - $s3, which it restores on return.
+ */
+inline const std::string runtime = R"(
+yac_apply:
+	addiu $sp, $sp, -20
+	sw $ra, 16($sp)
+	sw $s0, 12($sp)
+	sw $s1, 8($sp)
+	sw $s2, 4($sp)
+	sw $s3, 0($sp)
+	move $s2, $a1
+	sll $t0, $a1, 2
+	addu $t0, $t0, $sp
+	addiu $s1, $t0, 16
+	lw $s3, 20($t0)
+yac_apply_loop:
+	beqz $s2, yac_apply_done
+	lw $t0, 4($s3)
+	lw $t1, 8($s3)
+	subu $t2, $t0, $t1
+	lw $t3, 12($s3)
+	addu $t4, $t0, $t3
+	sll $t4, $t4, 2
+	addiu $t4, $t4, 16
+	sltu $t5, $s2, $t2
+	bnez $t5, yac_apply_partial
+	subu $sp, $sp, $t4
+	move $t5, $sp
+	move $t6, $s3
+	move $t7, $t4
+yac_apply_copy:
+	lw $t8, 0($t6)
+	sw $t8, 0($t5)
+	addiu $t5, $t5, 4
+	addiu $t6, $t6, 4
+	addiu $t7, $t7, -4
+	bnez $t7, yac_apply_copy
+	sw $t4, 8($sp)
+	subu $s2, $s2, $t2
+	sll $t5, $t1, 2
+	addu $t5, $t5, $sp
+	addiu $t5, $t5, 16
+yac_apply_fill:
+	beqz $t2, yac_apply_call
+	lw $t6, 0($s1)
+	sw $t6, 0($t5)
+	addiu $s1, $s1, -4
+	addiu $t5, $t5, 4
+	addiu $t2, $t2, -1
+	j yac_apply_fill
+yac_apply_call:
+	move $s0, $sp
+	lw $t0, 0($s0)
+	jalr $t0
+	lw $t4, 8($sp)
+	addu $sp, $sp, $t4
+	move $s3, $v0
+	j yac_apply_loop
+yac_apply_partial:
+	move $a0, $t4
+	li $v0, 9
+	syscall
+	move $t5, $v0
+	move $t6, $s3
+	move $t7, $t4
+yac_apply_heap_copy:
+	lw $t8, 0($t6)
+	sw $t8, 0($t5)
+	addiu $t5, $t5, 4
+	addiu $t6, $t6, 4
+	addiu $t7, $t7, -4
+	bnez $t7, yac_apply_heap_copy
+	addu $t6, $t1, $s2
+	sw $t6, 8($v0)
+	sll $t5, $t1, 2
+	addu $t5, $t5, $v0
+	addiu $t5, $t5, 16
+yac_apply_heap_fill:
+	lw $t6, 0($s1)
+	sw $t6, 0($t5)
+	addiu $s1, $s1, -4
+	addiu $t5, $t5, 4
+	addiu $s2, $s2, -1
+	bnez $s2, yac_apply_heap_fill
+	move $s3, $v0
+	j yac_apply_loop
+yac_apply_done:
+	move $v0, $s3
+	lw $s3, 0($sp)
+	lw $s2, 4($sp)
+	lw $s1, 8($sp)
+	lw $s0, 12($sp)
+	lw $ra, 16($sp)
+	addiu $sp, $sp, 20
+	jr $ra)";
+
+class MipsGenerator {
+  public:
+    const Program* program;  // should be observer_ptr
+    std::string ret;
+
+    explicit MipsGenerator(const Program* program): program(program) {}
+
+    void emit(const std::string& line) {
+        ret += "\n\t" + line;
+    }
+
+    void label(const std::string& name) {
+        ret += "\n" + name + ":";
+    }
+
+    void push(const std::string& reg) {
+        emit("addiu $sp, $sp, -4");
+        emit("sw " + reg + ", 0($sp)");
+    }
+
+    void pop(const std::string& reg) {
+        emit("lw " + reg + ", 0($sp)");
+        emit("addiu $sp, $sp, 4");
+    }
+
+    static std::string chunk_label(size_t index) {
+        return "yac_chunk_" + std::to_string(index);
+    }
+
+    static std::string slot(size_t index) {
+        return std::to_string(16 + index * 4);
+    }
+
+    void generate() {
+        generate_data();
+        ret += "\n.text";
+        generate_main();
+        for (size_t i = 0; i < program->chunks.size(); ++i) generate_chunk(i);
+        ret += runtime;
+    }
+
+    /**
+     * @brief Emit closure records of builtins and the table of global
+     *        variables, whose first entries are builtins.
+     */
+    void generate_data() {
+        ret += ".data";
+        ret += "\nyac_true: .asciiz \"True\"";
+        ret += "\nyac_false: .asciiz \"False\"";
+        ret += "\n.align 2";
+        for (size_t i = 0; i < program->builtin_num; ++i) {
+            ret += "\nyac_builtin_" + std::to_string(i) + ": .word " +
+                   chunk_label(i) + ", " +
+                   std::to_string(program->chunks[i]->arg_num) + ", 0, 0";
+            for (size_t j = 0; j < program->chunks[i]->arg_num; ++j)
+                ret += ", 0";
+        }
+        ret += "\nyac_globals: .word ";
+        for (size_t i = 0; i < program->builtin_num; ++i)
+            ret += (i ? ", yac_builtin_" : "yac_builtin_") + std::to_string(i);
+        size_t global_num = 0;
+        for (auto&& i : program->entries)
+            if (!i.is_output) ++global_num;
+        if (global_num)
+            ret += "\nyac_globals_user: .space " +
+                   std::to_string(global_num * 4);
+    }
+
+    void generate_main() {
+        label("main");
+        auto global = program->builtin_num;
+        for (size_t i = 0; i < program->entries.size(); ++i) {
+            auto& entry = program->entries[i];
+            emit("jal " + chunk_label(entry.chunk));
+            if (!entry.is_output) {
+                emit("la $t0, yac_globals");
+                emit("sw $v0, " + std::to_string(global++ * 4) + "($t0)");
+            } else if (entry.type == analysis::t_int) {
+                emit("move $a0, $v0");
+                emit("li $v0, 1");
+                emit("syscall");
+            } else if (entry.type == analysis::t_char) {
+                emit("move $a0, $v0");
+                emit("li $v0, 11");
+                emit("syscall");
+            } else {
+                auto name = "yac_output_" + std::to_string(i);
+                emit("la $a0, yac_false");
+                emit("beqz $v0, " + name);
+                emit("la $a0, yac_true");
+                label(name);
+                emit("li $v0, 4");
+                emit("syscall");
+            }
+        }
+        emit("li $v0, 10");
+        emit("syscall");
+    }
+
+    void generate_chunk(size_t index) {
+        auto& chunk = *program->chunks[index];
+        std::set<size_t> targets;
+        for (auto&& i : chunk.code)
+            if (i.op == OpCode::kJump || i.op == OpCode::kJumpIfNot)
+                targets.insert(i.arg);
+
+        auto name = chunk_label(index);
+        label(name);
+        push("$ra");
+        for (size_t i = 0; i < chunk.code.size(); ++i) {
+            if (targets.count(i)) label(name + "_" + std::to_string(i));
+            generate_instr(chunk.code[i], name);
+        }
+    }
+
+    void generate_instr(const Instr& instr, const std::string& name) {
+        auto arg = std::to_string(instr.arg);
+        switch (instr.op) {
+        case OpCode::kConst:
+            emit("li $t0, " + arg);
+            push("$t0");
+            return;
+        case OpCode::kArg:
+            emit("lw $t0, " + slot(instr.arg) + "($s0)");
+            push("$t0");
+            return;
+        case OpCode::kGlobal:
+            emit("la $t0, yac_globals");
+            emit("lw $t0, " + std::to_string(instr.arg * 4) + "($t0)");
+            push("$t0");
+            return;
+        case OpCode::kClosure: {
+            auto& chunk = *program->chunks[instr.arg];
+            auto size = 16 + (chunk.arg_num + chunk.captures.size()) * 4;
+            emit("li $a0, " + std::to_string(size));
+            emit("li $v0, 9");
+            emit("syscall");
+            emit("la $t0, " + chunk_label(instr.arg));
+            emit("sw $t0, 0($v0)");
+            emit("li $t0, " + std::to_string(chunk.arg_num));
+            emit("sw $t0, 4($v0)");
+            emit("sw $zero, 8($v0)");
+            emit("li $t0, " + std::to_string(chunk.captures.size()));
+            emit("sw $t0, 12($v0)");
+            for (size_t i = 0; i < chunk.captures.size(); ++i) {
+                emit("lw $t0, " + slot(chunk.captures[i]) + "($s0)");
+                emit("sw $t0, " + slot(chunk.arg_num + i) + "($v0)");
+            }
+            push("$v0");
+            return;
+        }
+        case OpCode::kCall:
+        case OpCode::kTailCall:
+            emit("li $a1, " + arg);
+            emit("jal yac_apply");
+            emit("addiu $sp, $sp, " + std::to_string((instr.arg + 1) * 4));
+            push("$v0");
+            return;
+        case OpCode::kJump:
+            emit("j " + name + "_" + arg);
+            return;
+        case OpCode::kJumpIfNot:
+            pop("$t0");
+            emit("beqz $t0, " + name + "_" + arg);
+            return;
+        case OpCode::kReturn:
+            emit("lw $v0, 0($sp)");
+            emit("lw $ra, 4($sp)");
+            emit("addiu $sp, $sp, 8");
+            emit("jr $ra");
+            return;
+        case OpCode::kNegate:
+            pop("$t0");
+            emit("subu $t0, $zero, $t0");
+            push("$t0");
+            return;
+        case OpCode::kNot:
+            pop("$t0");
+            emit("sltiu $t0, $t0, 1");
+            push("$t0");
+            return;
+        default:
+            break;
+        }
+
+        pop("$t1");
+        pop("$t0");
+        switch (instr.op) {
+        case OpCode::kAdd:
+            emit("addu $t0, $t0, $t1");
+            break;
+        case OpCode::kSub:
+            emit("subu $t0, $t0, $t1");
+            break;
+        case OpCode::kMul:
+            emit("mul $t0, $t0, $t1");
+            break;
+        case OpCode::kDiv:
+            emit("div $t0, $t1");
+            emit("mflo $t0");
+            break;
+        case OpCode::kMod:
+            emit("div $t0, $t1");
+            emit("mfhi $t0");
+            break;
+        case OpCode::kEq:
+            emit("xor $t0, $t0, $t1");
+            emit("sltiu $t0, $t0, 1");
+            break;
+        case OpCode::kNeq:
+            emit("xor $t0, $t0, $t1");
+            emit("sltu $t0, $zero, $t0");
+            break;
+        case OpCode::kLt:
+            emit("slt $t0, $t0, $t1");
+            break;
+        case OpCode::kGt:
+            emit("slt $t0, $t1, $t0");
+            break;
+        case OpCode::kLeq:
+            emit("slt $t0, $t1, $t0");
+            emit("xori $t0, $t0, 1");
+            break;
+        case OpCode::kGeq:
+            emit("slt $t0, $t0, $t1");
+            emit("xori $t0, $t0, 1");
+            break;
+        case OpCode::kAnd:
+            emit("sltu $t0, $zero, $t0");
+            emit("sltu $t1, $zero, $t1");
+            emit("and $t0, $t0, $t1");
+            break;
+        default:
+            emit("or $t0, $t0, $t1");
+            emit("sltu $t0, $zero, $t0");
+            break;
+        }
+        push("$t0");
+    }
+};
+
+}  // namespace internal
+
+/**
+ * @brief Generate MIPS assembly running program. Functions are compiled into
+ *        code, so nothing is evaluated at compile time. Calls in tail position
+ *        are ordinary calls.
+ * @param program Compiled bytecode.
+ */
+inline std::string generate_mips(const analysis::Program& program) {
+    internal::MipsGenerator generator(&program);
+    generator.generate();
+    return std::move(generator.ret);
+}
+
+}  // namespace yacis::asm_gen
+
+#endif  // YACIS_ASM_GEN_MIPS_HPP_
@@ -64,6 +64,16 @@ struct TypeNameInfo {
     std::string name;
 };
 
+struct LambdaExprInfo {
+    // Slots in the frame of the enclosing lambda, copied into the closure in
+    // order. Filled in by replace.
+    std::vector<size_t> captures;
+};
+
+struct ValueAssignInfo {
+    analysis::Type type;
+};
+
 struct OutputInfo {
     analysis::Type type;
 };
@@ -81,11 +91,11 @@ using ApplExprNode = Node<NodeTag::kApplExpr>;
 using CondExprNode = Node<NodeTag::kCondExpr>;
 using LetExprNode = Node<NodeTag::kLetExpr>;
 using LambdaParamNode = Node<NodeTag::kLambdaParam>;
-using LambdaExprNode = Node<NodeTag::kLambdaExpr>;
+using LambdaExprNode = Node<NodeTag::kLambdaExpr, LambdaExprInfo>;
 
 using TypeAliasNode = Node<NodeTag::kTypeAlias>;
 using TypeAssignNode = Node<NodeTag::kTypeAssign>;
-using ValueAssignNode = Node<NodeTag::kValueAssign>;
+using ValueAssignNode = Node<NodeTag::kValueAssign, ValueAssignInfo>;
 using OutputNode = Node<NodeTag::kOutput, OutputInfo>;
 
 class ValNode;
@@ -263,7 +273,7 @@ class ValNode: public BaseNode {
 
 class ArgNode: public BaseNode {
   public:
-    size_t index;
+    size_t index;  // slot in the frame of the innermost lambda
 
     explicit ArgNode(size_t index):
         BaseNode(BaseNode(), NodeTag::kArg), index(index) {}
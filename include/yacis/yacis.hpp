@@ -1,17 +1,35 @@
 #ifndef YACIS_YACIS_HPP_
 #define YACIS_YACIS_HPP_
 
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "tao/pegtl/contrib/parse_tree.hpp"
+#include "yacis/analysis/arena.hpp"
+#include "yacis/analysis/budget.hpp"
+#include "yacis/analysis/bytecode.hpp"
 #include "yacis/analysis/check.hpp"
+#include "yacis/analysis/depend.hpp"
 #include "yacis/analysis/error.hpp"
 #include "yacis/analysis/eval.hpp"
+#include "yacis/analysis/fold.hpp"
+#include "yacis/analysis/inline.hpp"
+#include "yacis/analysis/jit.hpp"
+#include "yacis/analysis/memo.hpp"
+#include "yacis/analysis/option.hpp"
+#include "yacis/analysis/pool.hpp"
+#include "yacis/analysis/profile.hpp"
 #include "yacis/analysis/replace.hpp"
+#include "yacis/analysis/stats.hpp"
 #include "yacis/analysis/symbol_table.hpp"
+#include "yacis/analysis/trace.hpp"
 #include "yacis/analysis/type.hpp"
+#include "yacis/analysis/vm.hpp"
 #include "yacis/analysis/yac_obj.hpp"
+#include "yacis/asm_gen/c.hpp"
+#include "yacis/asm_gen/mips.hpp"
 #include "yacis/ast/node.hpp"
 #include "yacis/ast/selector.hpp"
 #include "yacis/grammar/grammar.hpp"
@@ -23,73 +41,83 @@ namespace yacis {
 using file_input = tao::pegtl::file_input<>;
 using string_input = tao::pegtl::string_input<>;
 
+/**
+ * @brief Parse input and run analysis before evaluation.
+ */
 template<typename Input>
-inline std::vector<std::pair<int32_t, analysis::Type>>
-compile_to_output(Input&& input) {
+inline std::unique_ptr<ast::BaseNode>
+compile_to_ast(Input&& input, const analysis::EvalOption& option = {}) {
+    // Run pass on root as an event of option.trace named name.
+    auto traced = [&](const char* name, auto&& pass) {
+        analysis::TraceSpan span(option.trace, name, "compile");
+        pass();
+    };
     try {
-        auto root = tao::pegtl::parse_tree::
-            parse<grammar::Grammar, ast::BaseNode, ast::Selector>(
-                std::forward<Input>(input));
-        analysis::check(root);
-        analysis::replace(root);
-        return analysis::eval(root);
+        std::unique_ptr<ast::BaseNode> root;
+        traced("parse", [&] {
+            root = tao::pegtl::parse_tree::
+                parse<grammar::Grammar, ast::BaseNode, ast::Selector>(
+                    std::forward<Input>(input));
+        });
+        traced("check", [&] { analysis::check(root); });
+        traced("replace", [&] { analysis::replace(root); });
+        if (option.inline_limit)
+            traced("inline_calls", [&] {
+                analysis::inline_calls(
+                    root, option.inline_limit, option.memoize);
+            });
+        if (option.fold)
+            traced("fold", [&] {
+                auto report = analysis::fold(root);
+                if (option.fold_report) *option.fold_report = std::move(report);
+            });
+        if (option.eliminate_dead)
+            traced("eliminate_dead", [&] { analysis::eliminate_dead(root); });
+        return root;
     } catch (const tao::pegtl::parse_error& e) {
         throw analysis::ParseError(e.positions[0], "Syntax error.");
     }
 }
 
 template<typename Input>
-inline std::string compile_to_asm(Input&& input) {
-    auto output = compile_to_output(std::forward<Input>(input));
-    // clang-format off
-    std::string ret = "main:";
-    for (const auto& i : output) {
-        if (i.second == analysis::t_int) {
-            uint32_t val = i.first;  // convert to unsigned for bit operations
-            if (val > 0x0000ffffu)
-                ret += "\n\taddiu $v0, $zero, 1"
-                       "\n\tlui $a0, " +
-                       std::to_string((val & 0xffff0000u) >> 16u) +
-                       "\n\taddiu $a0, $a0, " +
-                       std::to_string(val & 0x0000ffffu) +
-                       "\n\tsyscall";
-            else
-                ret += "\n\taddiu $v0, $zero, 1"
-                       "\n\taddiu $a0, $zero, " +
-                       std::to_string(val & 0x0000ffffu) +
-                       "\n\tsyscall";
-        } else if (i.second == analysis::t_char) {
-            char val = i.first;
-            ret += "\n\taddiu $v0, $zero, 11"
-                   "\n\taddiu $a0, $zero, " + std::to_string(val) +
-                   "\n\tsyscall";
-        } else {
-            if (i.first)
-                ret += "\n\taddiu $v0, $zero, 11"
-                       "\n\taddiu $a0, $zero, " + std::to_string('T') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('r') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('u') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('e') +
-                       "\n\tsyscall";
-            else
-                ret += "\n\taddiu $v0, $zero, 11"
-                       "\n\taddiu $a0, $zero, " + std::to_string('F') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('a') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('l') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('s') +
-                       "\n\tsyscall"
-                       "\n\taddiu $a0, $zero, " + std::to_string('e') +
-                       "\n\tsyscall";
-        }
+inline std::vector<std::pair<int32_t, analysis::Type>>
+compile_to_output(Input&& input, const analysis::EvalOption& option = {}) {
+    auto root = compile_to_ast(std::forward<Input>(input), option);
+    if (option.engine == analysis::Engine::kBytecode) {
+        analysis::TraceSpan span(option.trace, "vm_eval", "eval");
+        return analysis::vm_eval(root, option);
     }
-    // clang-format on
-    return ret;
+    analysis::TraceSpan span(option.trace, "eval", "eval");
+    return analysis::eval(root, option);
+}
+
+/**
+ * @brief Compile input into MIPS assembly, which evaluates the program when it
+ *        runs. Only analysis options in option are used.
+ */
+template<typename Input>
+inline std::string compile_to_asm(Input&& input,
+                                  const analysis::EvalOption& option = {}) {
+    auto root = compile_to_ast(std::forward<Input>(input), option);
+    analysis::Program program;
+    {
+        analysis::TraceSpan span(option.trace, "compile_bytecode", "compile");
+        program = analysis::compile_bytecode(root);
+    }
+    analysis::TraceSpan span(option.trace, "generate_mips", "compile");
+    return asm_gen::generate_mips(program);
+}
+
+/**
+ * @brief Compile input into a C99 program, which can be built by the system C
+ *        compiler. Only analysis options in option are used.
+ */
+template<typename Input>
+inline std::string compile_to_c(Input&& input,
+                                const analysis::EvalOption& option = {}) {
+    auto root = compile_to_ast(std::forward<Input>(input), option);
+    analysis::TraceSpan span(option.trace, "generate_c", "compile");
+    return asm_gen::generate_c(root);
 }
 
 }  // namespace yacis
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "yacis/yacis.hpp"
+
+namespace {
+
+using namespace yacis;
+
+/**
+ * @brief Program generator of a workload, scaled by size.
+ */
+struct Workload {
+    std::string name;
+    std::vector<size_t> sizes;
+    std::function<std::string(size_t)> generate;
+};
+
+// Deep tail recursion, like fibHelper in examples/fibonacci.yac.
+std::string tail_program(size_t size) {
+    return "fibHelper : Int -> Int -> Int -> Int\n"
+           "fibHelper = \\n:Int n1:Int n2:Int ->\n"
+           "    if eq n 0\n"
+           "        then n1\n"
+           "        else fibHelper (sub n 1) n2 (mod (add n1 n2) 1000007)\n"
+           "fibHelper " +
+           std::to_string(size) + " 0 1\n";
+}
+
+// Tree recursion, a call tree of about 1.6^size nodes.
+std::string tree_program(size_t size) {
+    return "fib : Int -> Int\n"
+           "fib = \\n:Int ->\n"
+           "    if lt n 2\n"
+           "        then n\n"
+           "        else add (fib (sub n 1)) (fib (sub n 2))\n"
+           "fib " +
+           std::to_string(size) + "\n";
+}
+
+// Higher-order functions and partial applications, like examples/pair.yac.
+std::string pipeline_program(size_t size) {
+    return "pair = \\a:Int b:Int f:(Int -> Int -> Int) -> f a b\n"
+           "compose = \\f:(Int -> Int) g:(Int -> Int) x:Int -> f (g x)\n"
+           "step = \\k:Int x:Int -> mod (add (mul x 31) k) 1000003\n"
+           "run : Int -> Int -> Int\n"
+           "run = \\n:Int acc:Int ->\n"
+           "    if eq n 0\n"
+           "        then acc\n"
+           "        else run (sub n 1) (compose (step n) (step 7) acc)\n"
+           "pair (run " +
+           std::to_string(size) + " 1) 65536 mod\n";
+}
+
+// Many small outputs, like examples/hello_world.yac.
+std::string outputs_program(size_t size) {
+    std::string program;
+    for (size_t i = 0; i < size; ++i) {
+        if (i % 2)
+            program += "add " + std::to_string(i) + " 1\n";
+        else
+            program += "'" + std::string(1, char('a' + i % 26)) + "'\n";
+    }
+    return program;
+}
+
+struct Timing {
+    std::string phase;
+    std::vector<double> ms;
+};
+
+struct Result {
+    std::string workload;
+    size_t size;
+    uint32_t checksum;  // of outputs, which any two builds should agree on
+    std::vector<Timing> timings;
+};
+
+template<typename F>
+double time_ms(F&& f) {
+    auto begin = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+/**
+ * @brief Run each phase of compiling and evaluating program runs times.
+ */
+Result run(const Workload& workload, size_t size, size_t runs) {
+    auto program = workload.generate(size);
+    analysis::EvalOption option;
+    Result result{workload.name, size, 0, {}};
+    for (const char* phase :
+         {"parse", "check", "replace", "optimize", "eval", "compile_to_asm"})
+        result.timings.push_back({phase, {}});
+
+    for (size_t i = 0; i < runs; ++i) {
+        std::unique_ptr<ast::BaseNode> root;
+        std::vector<std::pair<int32_t, analysis::Type>> output;
+        auto timing = result.timings.begin();
+        (timing++)->ms.push_back(time_ms([&] {
+            root = tao::pegtl::parse_tree::
+                parse<grammar::Grammar, ast::BaseNode, ast::Selector>(
+                    string_input(program, workload.name));
+        }));
+        (timing++)->ms.push_back(time_ms([&] { analysis::check(root); }));
+        (timing++)->ms.push_back(time_ms([&] { analysis::replace(root); }));
+        (timing++)->ms.push_back(time_ms([&] {
+            analysis::inline_calls(root, option.inline_limit, option.memoize);
+            analysis::fold(root);
+            analysis::eliminate_dead(root);
+        }));
+        (timing++)->ms.push_back(
+            time_ms([&] { output = analysis::eval(root, option); }));
+        (timing++)->ms.push_back(time_ms([&] {
+            compile_to_asm(string_input(program, workload.name), option);
+        }));
+
+        uint32_t checksum = 2166136261u;
+        for (auto&& [val, type] : output)
+            checksum = (checksum ^ static_cast<uint32_t>(val)) * 16777619u;
+        result.checksum = checksum;
+    }
+    return result;
+}
+
+std::string to_json(const std::vector<Result>& results, size_t runs) {
+    std::ostringstream out;
+    out << "{\n  \"runs\": " << runs << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto& result = results[i];
+        out << (i ? "," : "") << "\n    {\"workload\": \"" << result.workload
+            << "\", \"size\": " << result.size
+            << ", \"checksum\": " << result.checksum << ", \"phases\": {";
+        for (size_t j = 0; j < result.timings.size(); ++j) {
+            auto ms = result.timings[j].ms;
+            std::sort(ms.begin(), ms.end());
+            out << (j ? ", " : "") << "\"" << result.timings[j].phase
+                << "\": {\"min_ms\": " << ms.front()
+                << ", \"median_ms\": " << ms[ms.size() / 2] << "}";
+        }
+        out << "}}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+}  // namespace
+
+/**
+ * Usage: yacis_bench [--quick] [--runs <n>] [<path-to-output-file>]
+ *
+ * Times each phase of every workload at several sizes and writes the results
+ * as JSON, to stdout if no output file is given. --quick leaves out the
+ * largest size of each workload.
+ */
+int main(int argc, char* argv[]) {
+    size_t runs = 5;
+    bool quick = false;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(std::atoi(argv[++i]), 1);
+        } else if (!arg.empty() && arg[0] != '-' && output_path.empty()) {
+            output_path = arg;
+        } else {
+            std::cerr << "Unknown argument " << arg << "." << std::endl;
+            return 1;
+        }
+    }
+
+    const std::vector<Workload> workloads{
+        {"tail", {10000, 100000, 1000000}, tail_program},
+        {"tree", {16, 20, 24}, tree_program},
+        {"pipeline", {1000, 10000, 100000}, pipeline_program},
+        {"outputs", {100, 1000, 10000}, outputs_program},
+    };
+
+    std::vector<Result> results;
+    try {
+        for (auto&& workload : workloads) {
+            auto size_num = workload.sizes.size() - (quick ? 1 : 0);
+            for (size_t i = 0; i < size_num; ++i) {
+                std::cerr << workload.name << " " << workload.sizes[i]
+                          << std::endl;
+                results.push_back(run(workload, workload.sizes[i], runs));
+            }
+        }
+    } catch (const analysis::CompileError& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    auto json = to_json(results, runs);
+    if (output_path.empty())
+        std::cout << json;
+    else
+        std::ofstream(output_path) << json;
+}
@@ -0,0 +1,122 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "yacis/yacis.hpp"
+
+namespace {
+
+using namespace yacis;
+
+/**
+ * @brief Return outputs of path evaluated by compile_to_output, printed the
+ *        way yac_print of the C runtime does.
+ */
+std::string expected_output(const std::string& path) {
+    std::ostringstream out;
+    for (auto&& [val, type] : compile_to_output(file_input(path))) {
+        if (type == analysis::t_int)
+            out << val;
+        else if (type == analysis::t_char)
+            out << static_cast<char>(val);
+        else
+            out << (val ? "True" : "False");
+    }
+    return out.str();
+}
+
+/**
+ * @brief Directory of files of one run under temp_directory_path(), so that
+ *        concurrent runs do not overwrite each other. Removed when destroyed.
+ */
+class TempDir {
+  public:
+    TempDir() {
+        std::random_device device;
+        std::mt19937_64 engine(device());
+        auto base = std::filesystem::temp_directory_path();
+        do {
+            path = base / ("yacis_c_check_" + std::to_string(engine()));
+        } while (!std::filesystem::create_directory(path));
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    ~TempDir() {
+        std::error_code error;
+        std::filesystem::remove_all(path, error);
+    }
+
+    [[nodiscard]] const std::filesystem::path& get() const {
+        return path;
+    }
+
+  private:
+    std::filesystem::path path;
+};
+
+/**
+ * @brief Compile path into C, build it with cc at -O2, run it and return what
+ *        it prints. Throw std::runtime_error if it can not be built or run.
+ */
+std::string c_output(const std::string& path,
+                     const std::string& cc,
+                     const std::filesystem::path& dir) {
+    auto source = dir / "yacis_c_check.c";
+    auto binary = dir / "yacis_c_check.out";
+    auto result = dir / "yacis_c_check.txt";
+    std::ofstream(source) << compile_to_c(file_input(path));
+    auto build = cc + " -O2 -o \"" + binary.string() + "\" \"" +
+                 source.string() + "\"";
+    if (std::system(build.c_str()))
+        throw std::runtime_error("Failed to build with " + cc + ".");
+    auto run = "\"" + binary.string() + "\" > \"" + result.string() + "\"";
+    if (std::system(run.c_str()))
+        throw std::runtime_error("Failed to run the compiled program.");
+    std::ifstream in(result);
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+}
+
+}  // namespace
+
+/**
+ * Usage: yacis_c_check <path-to-input-file>...
+ *
+ * Compiles each file into C, builds it with the C compiler in the CC
+ * environment variable, cc if unset, and compares what it prints against
+ * compile_to_output. Exits with 1 if any of them differs or fails.
+ */
+int main(int argc, char* argv[]) {
+    const char* cc_env = std::getenv("CC");
+    std::string cc = cc_env && *cc_env ? cc_env : "cc";
+    TempDir dir;
+    int failed = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string path = argv[i];
+        try {
+            auto expected = expected_output(path);
+            auto actual = c_output(path, cc, dir.get());
+            if (actual == expected) {
+                std::cout << "OK   " << path << std::endl;
+                continue;
+            }
+            std::cout << "DIFF " << path << "\n  expected: " << expected
+                      << "\n  actual:   " << actual << std::endl;
+        } catch (const analysis::CompileError& e) {
+            std::cout << "FAIL " << path << "\n  " << e.what() << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cout << "FAIL " << path << "\n  " << e.what() << std::endl;
+        }
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "yacis/yacis.hpp"
+
+namespace {
+
+using namespace yacis;
+
+// Tail recursion accumulating results of div and mod, which must not build
+// chains of thunks in lazy mode.
+const char* const accumulate_program =
+    "loop : Int -> Int -> Int\n"
+    "loop = \\n:Int acc:Int -> if eq n 0 then acc else "
+    "loop (sub n 1) (add acc (mod n 7))\n"
+    "loop 20000 0\n"
+    "loop 200000 0\n"
+    "quot : Int -> Int -> Int\n"
+    "quot = \\n:Int acc:Int -> if eq n 0 then acc else "
+    "quot (sub n 1) (add acc (div 1000 n))\n"
+    "quot 200000 0\n";
+
+// Division by zero and INT_MIN / -1 that are never used.
+const char* const unused_program =
+    "const = \\a:Int b:Int -> a\n"
+    "divide = \\a:Int b:Int -> div a b\n"
+    "const 1 (divide 1 0)\n"
+    "const 2 (mod 1 0)\n"
+    "const 3 (div (sub (negate 2147483647) 1) (negate 1))\n";
+
+std::vector<int32_t> values(const std::string& name,
+                            const std::string& program,
+                            bool lazy) {
+    analysis::EvalOption option;
+    option.lazy = lazy;
+    std::vector<int32_t> ret;
+    for (auto&& [val, type] :
+         compile_to_output(string_input(program, name), option))
+        ret.push_back(val);
+    return ret;
+}
+
+/**
+ * @brief Return whether evaluating program in lazy mode gives expected,
+ *        reporting it as name otherwise.
+ */
+bool expect_values(const std::string& name,
+                   const std::string& program,
+                   const std::vector<int32_t>& expected) {
+    if (values(name, program, true) == expected) {
+        std::cout << "OK   " << name << std::endl;
+        return true;
+    }
+    std::cout << "FAIL " << name << ": values differ" << std::endl;
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    int failed = 0;
+    failed += !expect_values("accumulate",
+                             accumulate_program,
+                             values("accumulate", accumulate_program, false));
+    failed += !expect_values("unused", unused_program, {1, 2, 3});
+    return failed ? 1 : 0;
+}
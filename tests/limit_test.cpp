@@ -0,0 +1,86 @@
+#include <iostream>
+#include <string>
+
+#include "yacis/yacis.hpp"
+
+namespace {
+
+using namespace yacis;
+
+// Unbounded tail recursion, which runs in constant space on both engines.
+const char* const spin_program =
+    "spin : Int -> Int\n"
+    "spin = \\n:Int -> spin (add n 1)\n"
+    "spin 0\n";
+
+// Unbounded non-tail recursion, which overflows the native stack of the tree
+// engine unless nesting is stopped.
+const char* const unbounded_program =
+    "loop : Int -> Int\n"
+    "loop = \\n:Int -> add 1 (loop (add n 1))\n"
+    "loop 0\n";
+
+// Deep non-tail recursion, whose frames fit the native stack but take more
+// memory than allowed.
+const char* const deep_program =
+    "deep : Int -> Int\n"
+    "deep = \\n:Int -> if eq n 0 then 0 else add 1 (deep (sub n 1))\n"
+    "deep 20000\n";
+
+/**
+ * @brief Return whether evaluating program under option throws LimitError
+ *        tagged tag, reporting it as name otherwise.
+ */
+bool expect_limit(const std::string& name,
+                  const std::string& program,
+                  const analysis::EvalOption& option,
+                  analysis::LimitTag tag) {
+    try {
+        compile_to_output(string_input(program, name), option);
+    } catch (const analysis::LimitError& e) {
+        if (e.tag == tag) {
+            std::cout << "OK   " << name << ": " << e.what() << std::endl;
+            return true;
+        }
+        std::cout << "FAIL " << name << ": " << e.what() << std::endl;
+        return false;
+    }
+    std::cout << "FAIL " << name << ": no LimitError" << std::endl;
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    using analysis::LimitTag;
+    int failed = 0;
+    for (auto engine : {analysis::Engine::kTree, analysis::Engine::kBytecode}) {
+        auto is_tree = engine == analysis::Engine::kTree;
+        std::string prefix = is_tree ? "tree " : "bytecode ";
+        for (size_t threads : {1, 4}) {
+            auto suffix = threads > 1 ? " threads" : "";
+            analysis::EvalOption option;
+            option.engine = engine;
+            option.threads = threads;
+            option.max_steps = 100000;
+            failed += !expect_limit(prefix + "spin steps" + suffix,
+                                    spin_program,
+                                    option,
+                                    LimitTag::kSteps);
+            // The tree engine runs out of native stack before max_steps,
+            // while frames of the bytecode one are on the heap.
+            failed += !expect_limit(prefix + "unbounded" + suffix,
+                                    unbounded_program,
+                                    option,
+                                    is_tree ? LimitTag::kDepth
+                                            : LimitTag::kSteps);
+        }
+
+        analysis::EvalOption option;
+        option.engine = engine;
+        option.max_bytes = 1u << 20u;
+        failed += !expect_limit(
+            prefix + "deep bytes", deep_program, option, LimitTag::kBytes);
+    }
+    return failed ? 1 : 0;
+}